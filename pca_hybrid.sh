@@ -0,0 +1,16 @@
+#!/bin/bash -l
+
+#SBATCH -p debug
+#SBATCH -A m1523
+#SBATCH -N 50
+#SBATCH -t 00:05:00  
+#SBATCH -J 50nodes_hybrid
+#SBATCH -o 50nodes_hybrid
+
+# one rank per NUMA domain (two per Haswell node), each running 16 threads pinned to the cores of its socket,
+# instead of the 1600 single-threaded ranks of pca_job.sh
+export OMP_NUM_THREADS=16
+export OMP_PLACES=cores
+export OMP_PROC_BIND=close
+
+srun -n 100 -c 32 --cpu-bind=cores --cpu-freq=2300000 -u ./pca /global/cscratch1/sd/jialin/climate/oceanTemps.hdf5 temperatures 6349676 46715 20 output.hdf5
@@ -0,0 +1,198 @@
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pcalib.h"
+
+/* Benchmark and accuracy check of the PCA library on synthetic matrices, with no I/O:
+   pcabench numrows numcols [--name value ...]
+   generates a low-rank-plus-noise matrix with known singular values on the first p ranks for each p in --ranks, computes its
+   top numeigs singular values with each solver in --solvers and each numeigs in --numeigs, and checks them against the exact
+   ones. Every run prints the per-phase timings and kernel GFLOP/s of pcaReport (and appends a record with --report); each
+   rank count also gets the latency of a blocking allreduce of numcols doubles. The exit status is 1 if any run missed
+   --maxrelerr. Any other option is passed to pcaSetOption */
+
+#define MAX_SWEEP 32
+#define ALLREDUCE_REPS 20
+
+// parses a comma separated list of at most MAX_SWEEP entries of list into entries, returning how many there were
+int parseList(const char * list, char entries[][32]);
+
+int main(int argc, char **argv) {
+
+    long numrows;
+    int numcols;
+    int signalrank = 20; // --signalrank: number of singular values above the noise floor
+    double decay = 0.8; // --decay: ratio of successive singular values above the noise floor
+    double noise = 1e-3; // --noise: level of the noise floor
+    int seed = 1; // --seed: seed of the random singular vectors
+    int reps = 1; // --reps: runs of every configuration
+    double maxrelerr = 1e-8; // --maxrelerr: largest relative error in the top numeigs singular values that passes
+    char solvers[MAX_SWEEP][32], eigcounts[MAX_SWEEP][32], rankcounts[MAX_SWEEP][32];
+    int numsolvers = parseList("arpack,lanczos,rsvd", solvers); // --solvers
+    int numeigcounts = parseList("5", eigcounts); // --numeigs
+    int numrankcounts = 0; // --ranks: the rank counts to sweep, all of the ranks by default
+
+    MPI_Comm world = MPI_COMM_WORLD;
+    int mpi_size, mpi_rank, mpi_thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &mpi_thread_support);
+    MPI_Comm_size(world, &mpi_size);
+    MPI_Comm_rank(world, &mpi_rank);
+    if (argc < 3) {
+        if (mpi_rank == 0) {
+            printf("Usage: %s numrows numcols [--name value ...]\n", argv[0]);
+        }
+        MPI_Abort(world, -1);
+    }
+    numrows = atol(argv[1]);
+    numcols = atoi(argv[2]);
+
+    int idx;
+    for(idx = 3; idx < argc; idx = idx + 2) {
+        if (idx + 1 >= argc) {
+            if (mpi_rank == 0) {
+                printf("Missing value for option %s\n", argv[idx]);
+            }
+            MPI_Abort(world, -1);
+        }
+        if (strcmp(argv[idx], "--signalrank") == 0) {
+            signalrank = atoi(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--decay") == 0) {
+            decay = atof(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--noise") == 0) {
+            noise = atof(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--seed") == 0) {
+            seed = atoi(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--reps") == 0) {
+            reps = atoi(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--maxrelerr") == 0) {
+            maxrelerr = atof(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--solvers") == 0) {
+            numsolvers = parseList(argv[idx + 1], solvers);
+        } else if (strcmp(argv[idx], "--numeigs") == 0) {
+            numeigcounts = parseList(argv[idx + 1], eigcounts);
+        } else if (strcmp(argv[idx], "--ranks") == 0) {
+            numrankcounts = parseList(argv[idx + 1], rankcounts);
+        } else {
+            int status = pcaSetOption(argv[idx], argv[idx + 1]);
+            if (status != PCA_OK) {
+                if (mpi_rank == 0) {
+                    if (status == PCA_UNKNOWN_OPTION) {
+                        printf("Unknown option %s\n", argv[idx]);
+                    } else {
+                        printf("Bad value %s for option %s\n", argv[idx + 1], argv[idx]);
+                    }
+                }
+                MPI_Abort(world, -1);
+            }
+        }
+    }
+    if (numrankcounts == 0) {
+        sprintf(rankcounts[0], "%d", mpi_size);
+        numrankcounts = 1;
+    }
+    if (numsolvers <= 0 || numeigcounts <= 0 || numrankcounts < 0 || reps <= 0) {
+        if (mpi_rank == 0) {
+            printf("--solvers, --numeigs and --ranks take comma separated lists of at most %d entries, and --reps must be positive\n", MAX_SWEEP);
+        }
+        MPI_Abort(world, -1);
+    }
+
+    double * exact = (double *) malloc( numcols * sizeof(double));
+    double * allreducebuf = (double *) calloc( numcols, sizeof(double));
+    if (exact == NULL || allreducebuf == NULL) {
+        printf("Out of memory on process %d\n", mpi_rank);
+        exit(-1);
+    }
+    int failures = 0;
+    int rankidx, solveridx, eigidx, rep;
+    for(rankidx = 0; rankidx < numrankcounts; rankidx = rankidx + 1) {
+        int ranks = atoi(rankcounts[rankidx]);
+        if (ranks <= 0 || ranks > mpi_size) {
+            if (mpi_rank == 0) {
+                printf("Skipping %s ranks: the job has %d\n", rankcounts[rankidx], mpi_size);
+            }
+            continue;
+        }
+        // the first ranks ranks run this part of the sweep, the rest wait at the next split
+        MPI_Comm benchcomm;
+        MPI_Comm_split(world, mpi_rank < ranks ? 0 : MPI_UNDEFINED, mpi_rank, &benchcomm);
+        if (benchcomm == MPI_COMM_NULL) {
+            continue;
+        }
+
+        struct PcaContext * ctx = pcaGenerate(benchcomm, numrows, numcols, signalrank, decay, noise, seed, exact);
+
+        MPI_Barrier(benchcomm);
+        double tallreducestr = MPI_Wtime();
+        for(rep = 0; rep < ALLREDUCE_REPS; rep = rep + 1) {
+            MPI_Allreduce(MPI_IN_PLACE, allreducebuf, numcols, MPI_DOUBLE, MPI_SUM, benchcomm);
+        }
+        double tallreduce = (MPI_Wtime() - tallreducestr)/ALLREDUCE_REPS;
+
+        for(solveridx = 0; solveridx < numsolvers; solveridx = solveridx + 1) {
+            if (pcaSetContextOption(ctx, "--solver", solvers[solveridx]) != PCA_OK) {
+                if (mpi_rank == 0) {
+                    printf("Unknown solver %s\n", solvers[solveridx]);
+                }
+                MPI_Abort(world, -1);
+            }
+            for(eigidx = 0; eigidx < numeigcounts; eigidx = eigidx + 1) {
+                int numeigs = atoi(eigcounts[eigidx]);
+                for(rep = 0; rep < reps; rep = rep + 1) {
+                    struct PcaResult result;
+                    pcaResetTimers(ctx);
+                    MPI_Barrier(benchcomm);
+                    double tcomputestr = MPI_Wtime();
+                    pcaCompute(ctx, numeigs, &result);
+                    double tcompute = MPI_Wtime() - tcomputestr;
+                    pcaReport(ctx, tcompute);
+
+                    double relerr = 0;
+                    int vecidx;
+                    for(vecidx = 0; vecidx < result.numeigs; vecidx = vecidx + 1) {
+                        double err = fabs(result.singvals[vecidx] - exact[vecidx])/exact[vecidx];
+                        relerr = err > relerr ? err : relerr;
+                    }
+                    if (!(relerr <= maxrelerr)) {
+                        failures = failures + 1;
+                    }
+                    if (mpi_rank == 0) {
+                        printf("bench: ranks %d solver %s numeigs %d time %f max relative error %.3e allreduce %.3e s %s\n", ranks,
+                               solvers[solveridx], numeigs, tcompute, relerr, tallreduce, relerr <= maxrelerr ? "PASS" : "FAIL");
+                    }
+                    pcaFreeResult(&result);
+                }
+            }
+        }
+        pcaFree(ctx);
+        MPI_Comm_free(&benchcomm);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_MAX, world);
+    if (mpi_rank == 0) {
+        printf("bench: %s\n", failures > 0 ? "some runs missed --maxrelerr" : "all runs passed");
+    }
+    free(exact);
+    free(allreducebuf);
+    MPI_Finalize();
+    return failures > 0 ? 1 : 0;
+}
+
+int parseList(const char * list, char entries[][32]) {
+    int count = 0;
+    const char * start = list;
+    while (*start != '\0') {
+        const char * end = strchr(start, ',');
+        size_t length = end == NULL ? strlen(start) : (size_t) (end - start);
+        if (count == MAX_SWEEP || length == 0 || length >= 32) {
+            return -1;
+        }
+        memcpy(entries[count], start, length);
+        entries[count][length] = '\0';
+        count = count + 1;
+        start = end == NULL ? start + length : end + 1;
+    }
+    return count;
+}
@@ -0,0 +1,4326 @@
+#include "hdf5.h"
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include "cblas.h"
+#include "lapacke.h"
+#include "pcalib.h"
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_max_threads() 1
+#define omp_get_num_threads() 1
+#define omp_get_thread_num() 0
+#endif
+
+#define SOLVER_ARPACK 0
+#define SOLVER_RSVD 1
+#define SOLVER_LANCZOS 2
+
+#define READ_INDEPENDENT 0
+#define READ_COLLECTIVE 1
+#define READ_NODELEADER 2
+#define NUM_READ_MODES 3
+#define READ_CHUNK_MB 16 // size of the pieces a node leader reads and forwards to the other ranks on its node
+#define READ_PIECE_MB 1024 // largest single read of the in-memory load: MPI-IO counts the bytes of one access in an int
+#define MAX_COLLECTIVE_COUNT (1 << 30) // elements per call of a collective whose count may not fit in an int
+#define VARTARGET_BLOCK 8 // components of the first --vartarget attempt, doubled until they capture the target
+#define CHECKPOINT_FINGERPRINT_LEN 9
+#define CHECKPOINT_PARTITION_LEN 4
+#define CHECKPOINT_STATE_LEN 4 // matvecs done, next restart cycle, number of saved vectors - 1, restarts done
+
+// phases timed by the instrumentation layer, see phaseNames
+#define PHASE_READ 0
+#define PHASE_MOMENTS 1
+#define PHASE_GRAM_COMPUTE 2
+#define PHASE_GRAM_ALLREDUCE 3
+#define PHASE_BCAST 4
+#define PHASE_DSAUPD 5
+#define PHASE_RITZ 6
+#define PHASE_AV 7
+#define PHASE_SVD 8
+#define PHASE_WRITE 9
+#define PHASE_ORTH 10
+#define NUM_PHASES 11
+
+extern void dsaupd_(int * ido, char * bmat, int * n, char * which,
+                    int * nev, double * tol, double * resid, 
+                    int * ncv, double * v, int * ldv,
+                    int * iparam, int * ipntr, double * workd,
+                    double * workl, int * lworkl, int * info);
+
+extern void dseupd_(int *rvec, char *HowMny, int *select,
+                    double *d, double *Z, int *ldz,
+                    double *sigma, char *bmat, int *n,
+                    char *which, int *nev, double *tol,
+                    double *resid, int *ncv, double *V,
+                    int *ldv, int *iparam, int *ipntr,
+                    double *workd, double *workl,
+                    int *lworkl, int *info);
+
+lapack_int LAPACKE_dgesdd(int matrix_layout, char jobz, lapack_int m,
+    lapack_int n, double * a, lapack_int lda, double * s, double * u,
+    lapack_int ldu, double * vt, lapack_int ldvt);
+
+// future optimizations: use memory-aligned mallocs
+
+static void printvec(char * label, double * v, int numentries);
+static void printmat(char * label, double * mat, int height, int width);
+static void mattrans(const double * A, long m, long n, double * B);
+static void flipcolslr(double * A, long m, long n); 
+
+// zeroes numrows rows of rowbytes bytes in buffer, giving each thread the panels of panelrows rows that the static schedule
+// of the Gram kernels hands it, so under the first-touch page policy each page lands on the NUMA domain that computes on it
+static void firstTouchRows(void * buffer, long numrows, size_t rowbytes, int panelrows);
+
+#define DEBUGATAFLAG 0
+#define DEBUG_DISTMATVEC_FLAG 0
+#define DISPLAY_FLAG 0
+
+#define CONVERT_BLOCK_MB 16 // size of the double precision blocks single precision rows are converted into for BLAS-3 kernels
+#define PRECISION_SAMPLE_ROWS 256 // rows per rank used by checkSinglePrecisionAccuracy
+
+// Computes C = A'*(A*Omega), or C += A'*(A*Omega) if accumulate is set
+// Scratch should have the size of (A*Omega)
+static void multiplyGramianChunk(double A[], double Omega[], double C[], double Scratch[], int rowsA, int colsA, int colsOmega, int accumulate); 
+
+// Computes y = A'*(A*x), or y += A'*(A*x) if accumulate is set, in one sweep over A, threaded over row panels of panelkb kilobytes
+// ThreadScratch must hold omp_get_max_threads()*(colsA + gramPanelRows(colsA)) doubles; x and y may alias unless accumulating
+static void multiplyGramianVec(struct PcaContext * ctx, const double A[], const double x[], double y[], int rowsA, int colsA, int accumulate);
+
+// number of rows of an A with colsA columns that fit in a panelkb kilobyte cache panel (at least one)
+static int gramPanelRows(struct PcaContext * ctx, int colsA);
+
+// Single precision storage counterpart of multiplyGramianVec: the products are formed in single precision and accumulated in
+// double; also needs XSingle to hold colsA floats
+static void multiplyGramianVecSingle(struct PcaContext * ctx, const float A[], const double x[], double y[], int rowsA, int colsA, int accumulate);
+
+// reports the relative error of the single precision Gram matvec against the double precision one on a sample of each rank's rows
+static void checkSinglePrecisionAccuracy(struct PcaContext * ctx, char * infilename, char * datasetname);
+
+// computes t = A*x, threaded over rows
+static void multiplyAVec(const double A[], const double x[], double t[], int rowsA, int colsA);
+
+// computes columns firstcol..lastcol-1 of A'*t into y, threaded over rows with per-thread partial sums in ThreadScratch
+static void multiplyATransVecCols(struct PcaContext * ctx, const double A[], const double t[], double y[], int rowsA, int colsA, int firstcol, int lastcol);
+
+// computes a distributed matrix vector product against v, and updates v: v <- A'*A*v
+// (on a process grid v is only read and updated on rank 0)
+static void distributedGramianVecProd(struct PcaContext * ctx, double v[]);
+
+// computes this rank's unreduced contribution to A'*A*v in place, from memory or streamed panels in either precision
+static void localGramianVecProd(struct PcaContext * ctx, double v[]);
+
+// computes yseg <- (A'*A*x)seg when x and y are split into segments over the ranks (segcounts and segoffsets give every rank's
+// segment): the segments of x are allgathered into X (numcols long), and the local products are summed and scattered back in one
+// reduce-scatter, so no rank ever has to hold or broadcast more than the full vector
+static void segmentGramianVecProd(struct PcaContext * ctx, double xseg[], double yseg[], int segcounts[], int segoffsets[], double X[]);
+
+// the process grid version of the Gram matvec: rank 0's v is scattered over grid row 0 and broadcast down the grid columns,
+// A*x is reduced along the grid rows and A'*(A*x) along the grid columns, and the result is gathered back into v on rank 0.
+// Returns the time spent communicating
+static double gridGramianVecProd(struct PcaContext * ctx, double v[]);
+
+// sum-allreduce and broadcast of count doubles in calls of at most MAX_COLLECTIVE_COUNT elements, for the collectives whose
+// counts are products of the problem dimensions and may pass 2^31
+static void chunkedAllreduce(double buf[], long count, MPI_Comm comm);
+static void chunkedBcast(double buf[], long count, int root, MPI_Comm comm);
+
+// shares the next ARPACK request with the other ranks: ido and the vector in the 1D layout, only ido on a process grid
+static void shareArpackRequest(struct PcaContext * ctx, double vector[], int * ido);
+
+// splits total items into parts blocks, the first total % parts of them one larger, and returns the size and start of block part
+static void blockPartition(int total, int parts, int part, int * size, int * start);
+
+// like blockPartition, but for the rows: it hands out whole groups of align items so block boundaries fall on chunk
+// boundaries, or single items when align is 0 or there are fewer groups than parts. The total and the start are 64-bit,
+// the size is checked to fit the int dimensions of the BLAS and LAPACK calls
+static void alignedPartition(struct PcaContext * ctx, long total, int parts, int part, int align, int * size, long * start);
+
+// number of rows in a chunk of the input dataset, 0 if it is not chunked; called on rank 0
+static int datasetChunkRows(char * infilename, char * datasetname);
+
+// reads this rank's localrows-by-localcols block of A at (startingrow, startingcol) into buffer, as floats in single precision mode:
+// with independent or collective MPI-IO (using the --cbnodes/--cbbuffermb hints), or through one reader per node that forwards
+// each rank's rows over the node-local communicator
+static void readLocalBlock(struct PcaContext * ctx, char * infilename, char * datasetname, int mode, void * buffer);
+static void readLocalBlockNodeLeader(struct PcaContext * ctx, char * infilename, char * datasetname, void * buffer);
+
+// MPI-IO hints for reading in the given mode; the caller frees them
+static MPI_Info readHints(struct PcaContext * ctx, int mode);
+
+// splits the rows of a CSR input over the ranks so that each gets about the same number of stored entries (rank 0 reads
+// indptr and broadcasts the boundaries), setting localrows and startingrow
+static void sparsePartition(struct PcaContext * ctx, char * infilename, char * groupname);
+
+// reads this rank's rows of the CSR group (indptr, indices, data) into CsrRowPtr, CsrColIdx and CsrValues, with independent or
+// collective MPI-IO
+static void readLocalCsr(struct PcaContext * ctx, char * infilename, char * groupname, int mode);
+
+// sparse counterparts of multiplyGramianVec, multiplyGramianChunk and multiplyAChunk on this rank's CSR rows; their cost
+// scales with the stored entries. The Gram kernels keep per-thread partial sums of the columns, like multiplyGramianVec
+static void multiplyGramianVecCsr(struct PcaContext * ctx, const double x[], double y[], int accumulate);
+static void multiplyGramianChunkCsr(struct PcaContext * ctx, const double Omega[], double C[], int colsOmega);
+static void multiplyAChunkCsr(struct PcaContext * ctx, const double Omega[], double C[], int colsOmega);
+
+// sparse counterparts of the columnMomentsPanel and checksumPanel passes, over the stored entries only: adds this rank's column
+// sums and sums of squares into sums and sumsquares, and returns its checksum of A
+static void columnMomentsCsr(struct PcaContext * ctx, double sums[], double sumsquares[]);
+static double checksumCsr(struct PcaContext * ctx);
+
+// makes CsrPartials big enough for the per-thread partial sums of multiplyGramianChunkCsr with colsOmega columns; the buffer
+// is kept with the context and only grows, so the repeated block products of a solve reuse it
+static void reserveCsrPartials(struct PcaContext * ctx, int colsOmega);
+
+// times reps reads of every rank's block with each read mode and reports the best aggregate bandwidth of each on rank 0
+static void readBenchmark(struct PcaContext * ctx, char * infilename, char * datasetname, int reps);
+
+/* Checkpoints of the eigensolver state hold the numvecs-by-numcols block of saved vectors, each rank writing its segrows
+   entries of every vector from segstart (stored one after the other in Vsegs), the CHECKPOINT_STATE_LEN solver counters,
+   the ncv-by-ncv projected matrix T if there is one, a fingerprint of the problem and a record of the layout of the ranks
+   that wrote it. All ranks call these together. The file is written under a temporary name and renamed, so a job killed
+   mid-write leaves the previous checkpoint intact */
+static void writeCheckpoint(struct PcaContext * ctx, double state[], int numvecs, double Vsegs[], int segrows, int segstart, double T[], int ncv);
+
+// reads the checkpoint back if --resume is set and the file exists, after checking it was written for the same problem
+// (aborting if not); returns 1 if the state was restored. T, if not NULL, takes the arpackncv-by-arpackncv projected matrix.
+// The layout is deliberately not checked: the vectors are stored whole, so a job can resume on any number of ranks or grid
+static int readCheckpoint(struct PcaContext * ctx, double state[], int numvecs, double Vsegs[], int segrows, int segstart, double T[]);
+
+// the layout record of a checkpoint: ranks, grid shape and a weighted sum of the first rows of the ranks
+static void checkpointLayout(struct PcaContext * ctx, double layout[]);
+
+// the problem fingerprint: sizes, solver settings and a weighted checksum of A (one pass over A, computed once)
+static void checkpointFingerprint(struct PcaContext * ctx, double fingerprint[]);
+static void checksumPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg);
+
+// hash of the input file and dataset names, so a checkpoint is not resumed against a different input of the same shape
+static double checkpointNameHash(struct PcaContext * ctx, char * name);
+
+// reads the whole dataset name of a checkpoint into buf, aborting unless it exists with the extent dims (ndims of them)
+static void readCheckpointDataset(struct PcaContext * ctx, hid_t file_id, const char * name, int ndims, hsize_t dims[], double buf[]);
+
+// average time of a blocking allreduce of count doubles, the reference for how much communication the pipelined matvec hides
+static double timeBlockingAllreduce(struct PcaContext * ctx, int count);
+
+// computes A*Omega and stores in C, Scratch should have dimensions of C
+static void multiplyAChunk(double A[], double Omega[], double C[], int rowsA, int colsA, int colsOmega);
+
+// computes the thin SVD of the tall-skinny matrix distributed over tsqrcomm whose rows on this rank are Mlocal (rowsLocal-by-k) via TSQR:
+// the local R factors are reduced up a binary tree, rank 0 takes the SVD of the final R, and the left singular vectors are pushed
+// back down the tree so every rank ends up with its own rows of U; S and VT (k-by-k) are returned on every rank of tsqrcomm
+static void distributedTallSkinnySVD(struct PcaContext * ctx, MPI_Comm tsqrcomm, double Mlocal[], int rowsLocal, int k, double Ulocal[], double S[], double VT[]);
+
+// computes the QR factorization of the m-by-k row major matrix M, returning the k-by-k R and the m-by-k Q (Q may alias M); also handles m < k
+static void localQR(struct PcaContext * ctx, double M[], int m, int k, double Q[], double R[]);
+
+// computes the distributed block product matProd <- A'*A*mat, where mat and matProd are numcols-by-numvecs; Scratch must hold localrows*numvecs
+static void distributedGramianMatProd(struct PcaContext * ctx, double mat[], double matProd[], double Scratch[], int numvecs);
+
+// computes this rank's rows of A*mat, where mat is numcols-by-numvecs, into matProd (on a process grid, summed over the grid row)
+static void localMatMatProd(struct PcaContext * ctx, double mat[], double matProd[], int numvecs);
+
+// computes the column means and sums of squares of A, and with --scale the column standard deviations, in one pass and one allreduce
+static void computeColumnMoments(struct PcaContext * ctx);
+
+// the total variance of A, its squared Frobenius norm (after centering and scaling, when they are on), from the column moments
+static double totalVariance(struct PcaContext * ctx);
+
+// writes D*mat into scaled (which may alias mat), D being the inverse column standard deviations (the identity without --scale),
+// and the shifts mu'*D*mat for the numvecs columns of mat into shifts
+static void centeringInput(struct PcaContext * ctx, double mat[], int numvecs, double scaled[], double shifts[]);
+
+// applies matProd <- D*(matProd - numrows*mu*shifts'), which turns A'*A*(D*mat) into the Gramian of the centered, scaled A times mat
+static void centerGramianOutput(struct PcaContext * ctx, double matProd[], int numvecs, double shifts[]);
+
+/* arguments and kernels for the panel loops in distributedGramianVecProd, distributedGramianMatProd and localMatMatProd */
+struct GramianVecPanelArgs {
+    double * x, * y;
+};
+struct GramianMatPanelArgs {
+    double * mat, * matProd, * Scratch;
+    int numvecs, accumulate;
+};
+struct MatMatPanelArgs {
+    double * mat, * matProd;
+    int numvecs;
+};
+struct ColumnMomentsPanelArgs {
+    double * sums, * sumsquares;
+};
+static void gramianVecPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg);
+static void gramianVecPanelSingle(struct PcaContext * ctx, float panel[], int panelrows, int firstrow, void * arg);
+static void gramianMatPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg);
+static void matMatPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg);
+static void columnMomentsPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg);
+
+// calls kernel(panel, panelrows, firstrow, arg) on successive row panels of this rank's block of A, firstrow counting from the
+// first local row. In memory the whole of Alocal is a single panel; when streaming, a reader thread fills one buffer from the
+// input file while the kernel works on the other. Single precision panels go to singlekernel, or, if that is NULL, are
+// converted to double a block of rows at a time and handed to kernel. CSR rows have kernels of their own and never come here
+static void forEachRowPanel(struct PcaContext * ctx, void (*kernel)(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg),
+                            void (*singlekernel)(struct PcaContext * ctx, float panel[], int panelrows, int firstrow, void * arg), void * arg);
+
+// hands one panel of this rank's rows (double or single precision, depending on the storage mode) to forEachRowPanel's kernels
+static void applyPanelKernel(struct PcaContext * ctx, void * panel, int panelrows, int firstrow, void (*kernel)(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg),
+                             void (*singlekernel)(struct PcaContext * ctx, float panel[], int panelrows, int firstrow, void * arg), void * arg);
+
+// runs ARPACK on rank 0 against the distributed Gramian; returns the top right singular vectors (descending, numcols-by-numeigs) on rank 0
+// and their singular values (descending) on every rank. If numwarm > 0, the numcols-by-numwarm warmVecs (needed on rank 0) are
+// the vectors of a smaller --vartarget attempt, and their sum plus a random part starts dsaupd
+static void arpackEigensolve(struct PcaContext * ctx, double rightSingVecs[], double singVals[], const double warmVecs[], int numwarm);
+
+// randomized subspace iteration on the Gramian with a block of numeigs + oversampling vectors; returns the same outputs as arpackEigensolve on every rank.
+// The warmVecs (needed on every rank) take the first numwarm columns of the starting block
+static void blockSubspaceIteration(struct PcaContext * ctx, double rightSingVecs[], double singVals[], const double warmVecs[], int numwarm);
+
+// thick-restart Lanczos on the Gramian with the Krylov basis split across the ranks; returns the same outputs as arpackEigensolve on every rank.
+// The warmVecs (needed on every rank) become the first thick restart state (see lanczosWarmStart)
+static void lanczosEigensolve(struct PcaContext * ctx, double rightSingVecs[], double singVals[], const double warmVecs[], int numwarm);
+
+// turns the numcols-by-numwarm warmVecs, Ritz vectors of an earlier Lanczos run, into a thick restart state: this rank's segments
+// of their Rayleigh-Ritz vectors and of the residual direction in the first numwarm + 1 basis vectors of V, and the arrowhead
+// T (ncv-by-ncv). Costs one Gram block product; returns numwarm, the k of the state
+static int lanczosWarmStart(struct PcaContext * ctx, const double warmVecs[], int numwarm, int ncv, double V[], long seglen, int segrows, int segstart, double T[]);
+
+// orthogonalizes the segments of w against the numbasis basis vectors stored seglen apart in V with two passes of classical
+// Gram-Schmidt, each a single allreduce; coeffs (2*numbasis + 1 long) returns the projections in its first numbasis entries.
+// Returns the norm of the orthogonalized w
+static double lanczosOrthogonalize(struct PcaContext * ctx, double V[], int numbasis, long seglen, int segrows, double w[], double coeffs[]);
+
+// deterministic pseudorandom entry globalidx of a Lanczos starting vector, so the start does not depend on the number of ranks
+static double lanczosStartEntry(long globalidx, int seed);
+
+// orthonormalizes the columns of the m-by-n row major matrix Q in place
+static void orthonormalize(struct PcaContext * ctx, double Q[], int m, int n);
+
+// writes U, S and V to outfname with parallel HDF5: every rank writes its own rows of U collectively, S and V (finalV, only needed on rank 0) are written once,
+// as are the column means and standard deviations if they are not NULL
+static void writeOutput(struct PcaContext * ctx, const char * outfname, double Ulocal[], double singvals[], double finalV[], double mean[], double std[]);
+
+// creates the ndims-dimensional double dataset name in file_id and collectively writes the count-sized block of buf at offset;
+// a rank with nothing to write passes count[0] = 0
+static void writeDatasetCollective(struct PcaContext * ctx, hid_t file_id, const char * name, int ndims, hsize_t dims[], hsize_t chunkrows, hsize_t offset[], hsize_t count[], double buf[]);
+
+// like writeDatasetCollective for a 2D dataset of which this rank holds numblocks blocks of whole rows, stored one after the
+// other in buf: blockcounts[i] rows from global row blockoffsets[i] on
+static void writeRowBlocksCollective(struct PcaContext * ctx, hid_t file_id, const char * name, hsize_t dims[], hsize_t chunkrows, int numblocks, hsize_t blockoffsets[], hsize_t blockcounts[], double buf[]);
+
+// creates outfname for a collective write, with --outalignment
+static hid_t createOutputFile(struct PcaContext * ctx, const char * outfname);
+
+// writes the replicated S, V and (when they are not NULL) mean and std of a numeigs-component decomposition into file_id
+static void writeComponents(struct PcaContext * ctx, hid_t file_id, double singvals[], double finalV[], double mean[], double std[]);
+
+
+// charges seconds of wall time on this rank to phase
+static void phaseAdd(struct PcaContext * ctx, int phase, double seconds);
+
+// counts the flops (flopsperentry per entry of A and right hand side) and the bytes of A moved by sweeps passes over this rank's rows
+static void countMatrixPass(struct PcaContext * ctx, double flopsperentry, int numvecs, int sweeps);
+
+// reduces the phase timers to their min, mean and max over the ranks, prints them on rank 0 and, with --report, appends
+// one record for this run to the report file: a JSON object per line, or a CSV row if the name ends in .csv
+static void writeTimingReport(struct PcaContext * ctx, char * infilename, double totaltime);
+
+// writes str to report as a quoted JSON string or CSV field, escaping what would break the record
+static void writeJsonString(FILE * report, const char * str);
+static void writeCsvField(FILE * report, const char * str);
+
+/* Settings, set by pcaSetOption (the defaults taken by new contexts) or pcaSetContextOption */
+struct PcaOptions {
+    /* solver options */
+    int solver; // --solver arpack|rsvd|lanczos
+    int oversampling; // --oversample: extra block vectors beyond numeigs for the rsvd solver
+    int poweriters; // --poweriters: number of subspace (power) iterations for the rsvd solver
+    double arpacktol; // --tol: ARPACK convergence tolerance on the Ritz values
+    int requestedncv; // --ncv: number of ARPACK Lanczos vectors, 0 picks min(2*numeigs, numcols)
+    int arpackmaxiter; // --maxiter: maximum number of ARPACK restarts
+    int panelkb; // --panelkb: size of the row panels in multiplyGramianVec, pick it to fit in L2
+    hsize_t outchunkrows; // --outchunkrows: rows per chunk of the U and V datasets, 0 stores them contiguously
+    hsize_t outalignment; // --outalignment: align every dataset in the output file on this many bytes (e.g. the Lustre stripe size), 0 leaves HDF5's packing alone
+    int commsegments; // --commsegments: column segments whose allreduces are pipelined behind the A'*(A*x) compute, 1 uses the fused kernel and a blocking allreduce
+    int singleprecision; // --precision single: store A in single precision, halving memory and matvec traffic
+    int center; // --center: compute the PCA of A with its column means removed, without forming the centered matrix
+    int scale; // --scale: also divide the columns by their standard deviations (implies --center)
+    double vartarget; // --vartarget: keep the fewest components, at most numeigs, that capture this fraction of the total variance; 0 keeps numeigs
+    char * reportfname; // --report: file the per-run timing record is appended to
+
+    /* input options */
+    int readmode; // --readmode independent|collective|nodeleader: how the in-memory path reads its block of A
+    int cbnodes; // --cbnodes: number of MPI-IO aggregators for collective reads, 0 leaves the MPI default
+    int cbbuffermb; // --cbbuffermb: MPI-IO collective buffer size in megabytes, 0 leaves the MPI default
+    int chunkalign; // --chunkalign: align the row partition on the chunks of a chunked input dataset
+
+    /* checkpointing */
+    char * checkpointfname; // --checkpoint: file the eigensolver state is saved to
+    int checkpointevery; // --checkpointevery: save the state at the first opportunity after this many matvecs
+    int resume; // --resume: restart the eigensolver from the checkpoint file, if there is one
+
+    /* storage, fixed once a matrix is loaded */
+    int sparse; // --sparse: the dataset name is a CSR group (indptr, indices, data) rather than a dense 2D dataset
+    int streaming; // --stream: 1 keeps the input open and reads Alocal in row panels on every pass instead of holding it in memory
+    int streammb; // --streammb: size of each of the two streaming panel buffers in megabytes
+    int streamrows; // --streamrows: rows per streamed panel, overrides --streammb
+    int gridrows, gridcols; // --grid PrxPc: distribute A in blocks over a Pr-by-Pc grid of ranks, 0 keeps the 1D row distribution
+};
+
+static struct PcaOptions defaultoptions = {
+    .solver = SOLVER_ARPACK,
+    .oversampling = 10,
+    .poweriters = 3, // keeps the leading singular values within pcabench's 1e-8 relative error at the default oversampling, 2 does not
+    .arpacktol = 1e-13,
+    .requestedncv = 0,
+    .arpackmaxiter = 30,
+    .panelkb = 256,
+    .outchunkrows = 0,
+    .outalignment = 0,
+    .commsegments = 1,
+    .singleprecision = 0,
+    .center = 0,
+    .scale = 0,
+    .vartarget = 0,
+    .reportfname = NULL,
+    .readmode = READ_INDEPENDENT,
+    .cbnodes = 0,
+    .cbbuffermb = 0,
+    .chunkalign = 1,
+    .checkpointfname = NULL,
+    .checkpointevery = 100,
+    .resume = 0,
+    .sparse = 0,
+    .streaming = 0,
+    .streammb = 64,
+    .streamrows = 0,
+    .gridrows = 0,
+    .gridcols = 0,
+};
+
+static const char * phaseNames[NUM_PHASES] = {"read", "moments", "gram_compute", "gram_allreduce", "bcast", "dsaupd", "ritz", "av", "svd", "write", "orthogonalize"};
+static const char * readModeNames[NUM_READ_MODES] = {"independent", "collective", "nodeleader"};
+
+/* The state of one loaded matrix and of the computations on it. Every kernel and solver takes the context it works on, so
+   contexts are independent of each other */
+struct PcaContext {
+    struct PcaOptions opts; // the settings of this context, copied from the defaults when it was created
+    MPI_Comm comm;
+    int mpi_size, mpi_rank, mpi_thread_support;
+    char * infilename, * datasetname; // the input names, for the checkpoint fingerprint and the timing report
+    int loaded; // whether the data was read, rather than just partitioned
+
+    /* the partition */
+    int numcols, numeigs; // number of columns in A, PCs desired
+    long numrows; // number of rows in A
+    int localrows; // number of rows on this processor, at most INT_MAX since they are passed to BLAS and LAPACK as ints
+    long startingrow; // index of the first row on this processor (0-based)
+    int localcols, startingcol; // the same for columns: all of them, unless A is distributed over a process grid
+
+    /* 2D process grid */
+    int gridrow, gridcol; // this rank's grid coordinates, rank = gridrow*gridcols + gridcol
+    MPI_Comm rowcomm, colcomm; // the ranks in this rank's grid row (which share its rows of A) and grid column (which share its columns)
+    int * gridcolcounts, * gridcoloffsets; // sizes and offsets of the column blocks, for scattering and gathering vectors over grid row 0
+    double * GridX, * GridT; // this rank's segment of x and its rows of A*x in gridGramianVecProd
+
+    /* the data and the buffers sized by it */
+    double * Alocal; // contains the batch of rows for this processor
+    float * AlocalSingle; // the same rows, when they are stored in single precision
+    float * XSingle; // the input vector of multiplyGramianVecSingle rounded to single precision
+    double * ConvertScratch; // blocks of single precision rows converted to double for the BLAS-3 kernels
+    int convertrows; // rows per block in ConvertScratch
+    double * AxScratch; // localrows entries of A*x for the pipelined distributedGramianVecProd
+    MPI_Request * gramrequests; // one outstanding allreduce per column segment in distributedGramianVecProd
+    double * ThreadScratch; // per-thread partial sums of A'*A*x and panel products A*x for multiplyGramianVec
+
+    /* sparse input */
+    long * CsrRowPtr; // localrows + 1 offsets of this rank's rows into CsrColIdx and CsrValues, starting from 0
+    int * CsrColIdx; // column of each stored entry
+    double * CsrValues;
+    long localnnz; // entries stored on this rank
+    double * CsrPartials; // per-thread partial sums of multiplyGramianChunkCsr, room for csrpartialcols columns
+    int csrpartialcols;
+
+    /* out-of-core streaming */
+    hid_t streamfile_id, streamdataset_id, streamfilespace, streamdxpl_id;
+    void * StreamBuffers[2];
+    double * StreamX; // copy of the input vector, since the streamed Gram matvec accumulates into its output
+
+    /* column moments and the checkpoint checksum of A, computed the first time they are needed */
+    double * colmeans; // mu, the column means of A
+    double * colstds; // the column standard deviations of A (constant columns get 1), only with --scale
+    double * colsumsquares; // the column sums of squares of A, for the total variance
+    double datachecksum; // weighted checksum of A for the checkpoint fingerprint
+    int datachecksumready;
+
+    /* the current computation and its instrumentation */
+    int arpackncv; // the number of ARPACK Lanczos vectors used by the current computation
+    int lastcheckpoint; // ngramcalls at the last checkpoint
+    double phaseTimes[NUM_PHASES]; // wall time this rank spent in each phase
+    int phaseCalls[NUM_PHASES];
+    double flopcount, bytecount; // flops and bytes of A moved by this rank's passes over its rows
+    double tgramtotal, tgramexposedcomm; // time spent in distributedGramianVecProd, and the part of it spent blocked on the allreduce
+    int ngramcalls;
+    double tstreamwait; // time the compute spent blocked on panel reads
+};
+
+// sets the option name in opts, returning PCA_BAD_VALUE if it does not exist or value does not parse
+static int setOption(struct PcaOptions * opts, const char * name, const char * value);
+
+// sets up a context for the rows of a numrows-by-numcols input distributed over pcacomm, with the default settings
+static struct PcaContext * newContext(MPI_Comm pcacomm, const char * infilename, const char * datasetname, long numrows, int numcols);
+
+// splits A over the ranks: the 1D row partition (aligned on the chunks of the input if alignonchunks is set), the CSR
+// partition balancing nonzeros, or the process grid; returns the rows per chunk the partition was aligned on, 0 if it was not
+static int partitionMatrix(struct PcaContext * ctx, int alignonchunks);
+
+// opens the input dataset for streaming and allocates the two panel buffers
+static void openStreamedInput(struct PcaContext * ctx);
+
+// allocates the per-matrix scratch buffers of the kernels once this rank's block of A is in place
+static void allocateScratch(struct PcaContext * ctx);
+
+// fills spectrum with the numcols singular values of the synthetic matrix: decay^i for the first signalrank, then a noise
+// floor falling linearly from noise to noise/2
+static void syntheticSpectrum(struct PcaContext * ctx, double spectrum[], int signalrank, double decay, double noise);
+
+// checks the settings against each other and against the context
+static void checkOptions(struct PcaContext * ctx);
+
+// whether the columns are centered: with --center, or implied by --scale
+static int centered(struct PcaContext * ctx);
+
+struct PcaContext * pcaLoad(MPI_Comm pcacomm, const char * infilename, const char * datasetname, long numrows, int numcols) {
+    struct PcaContext * ctx = newContext(pcacomm, infilename, datasetname, numrows, numcols);
+    if (ctx->mpi_rank == 0) {
+        printf("Running %d ranks with %d OpenMP threads each\n", ctx->mpi_size, omp_get_max_threads());
+    }
+
+    /* Allocate the correct portion of the input to each processor */
+    double rdmtxstr = MPI_Wtime();
+    int chunkrows = partitionMatrix(ctx, ctx->opts.chunkalign);
+
+    /* Load my portion of the data */
+
+    size_t elementsize = ctx->opts.singleprecision ? sizeof(float) : sizeof(double);
+    if (ctx->opts.sparse) {
+        if (ctx->mpi_rank == 0) {
+            printf("Starting to load the sparse matrix (%s reads)\n", readModeNames[ctx->opts.readmode]);
+        }
+        readLocalCsr(ctx, ctx->infilename, ctx->datasetname, ctx->opts.readmode);
+        long globalnnz = ctx->localnnz, maxnnz = ctx->localnnz;
+        MPI_Reduce(&ctx->localnnz, &globalnnz, 1, MPI_LONG, MPI_SUM, 0, ctx->comm);
+        MPI_Reduce(&ctx->localnnz, &maxnnz, 1, MPI_LONG, MPI_MAX, 0, ctx->comm);
+        if (ctx->mpi_rank == 0) {
+            printf("Finished loading %ld nonzeros (density %g, at most %ld on one rank)\n", globalnnz, (double) globalnnz/((double) numrows*numcols), maxnnz);
+        }
+    } else if (ctx->opts.streaming) {
+        openStreamedInput(ctx);
+    } else {
+        void * Abuffer = malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * ctx->localcols * elementsize);
+        if (ctx->opts.singleprecision) {
+            ctx->AlocalSingle = (float *) Abuffer;
+        } else {
+            ctx->Alocal = (double *) Abuffer;
+        }
+        if (Abuffer == NULL) {
+            printf("Out of memory in process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+        firstTouchRows(Abuffer, ctx->localrows, (size_t) ctx->localcols*elementsize, gramPanelRows(ctx, ctx->localcols));
+
+        //MPI_Barrier(ctx->comm);
+        if (ctx->mpi_rank == 0) {
+            printf("Starting to load matrix (%s reads%s)\n", readModeNames[ctx->opts.readmode], chunkrows > 0 ? ", partition aligned on chunks" : "");
+        }
+        readLocalBlock(ctx, ctx->infilename, ctx->datasetname, ctx->opts.readmode, Abuffer);
+        if (ctx->mpi_rank == 0) {
+            printf("Finished loading matrix\n");
+         }
+    }
+
+	double rdmtxstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_READ, rdmtxstp - rdmtxstr);
+	if(ctx->mpi_rank == 0)
+		printf("Time to readHDF5 matrix: %f\n", rdmtxstp - rdmtxstr); 
+
+    allocateScratch(ctx);
+    if (ctx->opts.singleprecision) {
+        checkSinglePrecisionAccuracy(ctx, ctx->infilename, ctx->datasetname);
+    }
+    ctx->loaded = 1;
+    return ctx;
+}
+
+struct PcaContext * pcaGenerate(MPI_Comm pcacomm, long numrows, int numcols, int signalrank, double decay, double noise, int seed, double exactsingvals[]) {
+    char name[256];
+    sprintf(name, "synthetic-r%d-d%g-n%g-s%d", signalrank, decay, noise, seed);
+    struct PcaContext * ctx = newContext(pcacomm, name, "", numrows, numcols);
+    if (ctx->opts.streaming || ctx->opts.sparse || numrows < numcols || signalrank < 0 || signalrank > numcols || decay <= 0 || decay > 1 || noise < 0) {
+        if (ctx->mpi_rank == 0) {
+            printf("A synthetic matrix is held in memory, dense, with at least as many rows as columns, 0 <= signal rank <= numcols, 0 < decay <= 1 and noise >= 0\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->mpi_rank == 0) {
+        printf("Running %d ranks with %d OpenMP threads each\n", ctx->mpi_size, omp_get_max_threads());
+    }
+    double tgenstr = MPI_Wtime();
+    partitionMatrix(ctx, 0);
+
+    /* A = (1/sqrt(b)) [D_0 P_0; D_1 P_1; ...; D_(b-1) P_(b-1); 0] W with W = Q*S*V', Q and V orthogonal: b blocks of numcols rows,
+       each a copy of W with its rows cyclically shifted (P_j) and their signs flipped (D_j), and zero rows past the last whole
+       block. Then A'*A = W'*W, so the singular values of A are exactly S, while every row depends only on its global index
+       and the matrix is the same for any number of ranks. Every rank forms W (3 numcols-by-numcols buffers at the peak) */
+    long n = numcols;
+    double * spectrum = (double *) malloc( numcols * sizeof(double));
+    double * Q = (double *) malloc( (size_t) n * n * sizeof(double));
+    double * V = (double *) malloc( (size_t) n * n * sizeof(double));
+    double * W = (double *) malloc( (size_t) n * n * sizeof(double));
+    double * R = (double *) malloc( (size_t) n * n * sizeof(double));
+    if (spectrum == NULL || Q == NULL || V == NULL || W == NULL || R == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    syntheticSpectrum(ctx, spectrum, signalrank, decay, noise);
+    long idx;
+    for(idx = 0; idx < n*n; idx = idx + 1) {
+        Q[idx] = lanczosStartEntry(idx, seed);
+        V[idx] = lanczosStartEntry(idx, seed + 1);
+    }
+    localQR(ctx, Q, numcols, numcols, Q, R);
+    localQR(ctx, V, numcols, numcols, V, R);
+    free(R);
+    int rowidx, colidx;
+    for(rowidx = 0; rowidx < numcols; rowidx = rowidx + 1) {
+        for(colidx = 0; colidx < numcols; colidx = colidx + 1) {
+            Q[rowidx*n + colidx] *= spectrum[colidx];
+        }
+    }
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, numcols, numcols, numcols, 1.0, Q, numcols, V, numcols, 0.0, W, numcols);
+    free(Q);
+    free(V);
+
+    size_t elementsize = ctx->opts.singleprecision ? sizeof(float) : sizeof(double);
+    void * Abuffer = malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * ctx->localcols * elementsize);
+    if (Abuffer == NULL) {
+        printf("Out of memory in process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->opts.singleprecision) {
+        ctx->AlocalSingle = (float *) Abuffer;
+    } else {
+        ctx->Alocal = (double *) Abuffer;
+    }
+    firstTouchRows(Abuffer, ctx->localrows, (size_t) ctx->localcols*elementsize, gramPanelRows(ctx, ctx->localcols));
+    long numblocks = numrows/n;
+    double blockscale = 1.0/sqrt((double) numblocks);
+    #pragma omp parallel for private(colidx) schedule(static)
+    for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+        long globalrow = ctx->startingrow + rowidx, block = globalrow/n;
+        double * source = W + ((globalrow % n + block) % n)*n + ctx->startingcol;
+        double factor = block >= numblocks ? 0 : (lanczosStartEntry(globalrow, seed + 2) < 0 ? -blockscale : blockscale);
+        for(colidx = 0; colidx < ctx->localcols; colidx = colidx + 1) {
+            if (ctx->opts.singleprecision) {
+                ctx->AlocalSingle[(long) rowidx*ctx->localcols + colidx] = (float) (factor*source[colidx]);
+            } else {
+                ctx->Alocal[(long) rowidx*ctx->localcols + colidx] = factor*source[colidx];
+            }
+        }
+    }
+    free(W);
+    allocateScratch(ctx);
+    // generating the matrix stands in for reading it
+    double tgenstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_READ, tgenstp - tgenstr);
+    if (ctx->mpi_rank == 0) {
+        printf("Time to generate the %ld x %d synthetic matrix: %f\n", numrows, numcols, tgenstp - tgenstr);
+    }
+
+    if (exactsingvals != NULL) {
+        // the spectrum is only sorted once the noise floor falls below the last signal value
+        int i, j;
+        for(i = 1; i < numcols; i = i + 1) {
+            double value = spectrum[i];
+            for(j = i; j > 0 && spectrum[j - 1] < value; j = j - 1) {
+                spectrum[j] = spectrum[j - 1];
+            }
+            spectrum[j] = value;
+        }
+        memcpy(exactsingvals, spectrum, numcols * sizeof(double));
+    }
+    free(spectrum);
+    ctx->loaded = 1;
+    return ctx;
+}
+
+void pcaCompute(struct PcaContext * ctx, int k, struct PcaResult * result) {
+    ctx->numeigs = k;
+    checkOptions(ctx);
+    // checked for the largest number of components; a --vartarget attempt with fewer gets its own default ncv
+    ctx->arpackncv = ctx->opts.requestedncv;
+    if (ctx->arpackncv == 0) {
+        ctx->arpackncv = 2*ctx->numeigs > ctx->numcols ? ctx->numcols : 2*ctx->numeigs; // ncv > nev and ncv <= n (but ncv >= 2*nev recommended)
+    }
+    if (ctx->numeigs <= 0 || ctx->arpackncv <= ctx->numeigs || ctx->arpackncv > ctx->numcols || ctx->opts.arpackmaxiter <= 0 || ctx->opts.arpacktol < 0) {
+        if (ctx->mpi_rank == 0) {
+            printf("Need 0 < numeigs < ncv <= numcols, maxiter > 0 and tol >= 0 (got numeigs = %d, ncv = %d, maxiter = %d, tol = %g)\n",
+                   ctx->numeigs, ctx->arpackncv, ctx->opts.arpackmaxiter, ctx->opts.arpacktol);
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    // the matvec counters and timers describe this computation
+    ctx->ngramcalls = 0;
+    ctx->lastcheckpoint = 0;
+    ctx->tgramtotal = 0.;
+    ctx->tgramexposedcomm = 0.;
+    ctx->tstreamwait = 0.;
+
+    if (ctx->opts.commsegments > 1) {
+        ctx->AxScratch = (double *) malloc( (ctx->localrows > 0 ? ctx->localrows : 1) * sizeof(double));
+        ctx->gramrequests = (MPI_Request *) malloc( ctx->opts.commsegments * sizeof(MPI_Request));
+        if (ctx->AxScratch == NULL || ctx->gramrequests == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+    }
+
+    // the moments are kept with the context, so later computations on the same matrix skip the pass
+    if ((centered(ctx) || ctx->opts.vartarget > 0) && (ctx->colmeans == NULL || (ctx->opts.scale && ctx->colstds == NULL))) {
+        double tmomentsstr = MPI_Wtime();
+        free(ctx->colmeans);
+        free(ctx->colstds);
+        free(ctx->colsumsquares);
+        computeColumnMoments(ctx);
+        phaseAdd(ctx, PHASE_MOMENTS, MPI_Wtime() - tmomentsstr);
+        if (ctx->mpi_rank == 0) {
+            printf("Time to compute column %s: %f\n", ctx->opts.scale ? "means and standard deviations" : "means", MPI_Wtime() - tmomentsstr);
+        }
+    }
+
+    // Check that the distributed matrix-vector multiply against A^TA works
+    if (DEBUGATAFLAG && !ctx->opts.streaming && !ctx->opts.singleprecision && !ctx->opts.sparse && ctx->opts.gridcols == 0) { 
+        double * vector = (double *) malloc( ctx->numcols * sizeof(double));
+       // display rows so we can check they're loaded correctly
+        int rowIdx;
+        char rowlabel[50];
+        for( rowIdx = 0; rowIdx < ctx->localrows; rowIdx = rowIdx + 1) {
+            sprintf(rowlabel, "row %ld, on process %d: ", rowIdx + ctx->startingrow, ctx->mpi_rank);
+            printvec(rowlabel, ctx->Alocal + (long) rowIdx*ctx->numcols, ctx->numcols);
+        }
+
+        // distribute the initial vector
+        if (ctx->mpi_rank == 0) {
+            int idx;
+            for( idx = 0; idx < ctx->numcols; idx = idx + 1) {
+                vector[idx] = idx + 1;
+            } 
+            printvec("test vector: ", vector, ctx->numcols);
+        }
+        MPI_Bcast(vector, ctx->numcols, MPI_DOUBLE, 0, ctx->comm);
+
+        // distributed matrix-vector product
+        distributedGramianVecProd(ctx, vector);
+
+       // display final product
+       if (ctx->mpi_rank == 0) {
+           printvec(" A * test vector: ", vector, ctx->numcols);
+       }
+       free(vector);
+    }
+
+    // with --vartarget, k only caps the number of components: the solver runs with a block of them and starts over with twice
+    // as many, seeded with the vectors it already has, until the leading ones capture the target fraction of the total variance,
+    // which costs at most about twice the final run and keeps ncv and the rank 0 ARPACK workspace sized by the components actually needed
+    double totalvar = ctx->opts.vartarget > 0 ? totalVariance(ctx) : 0., captured = 0.;
+    double * singVals = NULL, * rightSingVecs = NULL, * warmVecs = NULL;
+    int numwarm = 0;
+    ctx->numeigs = ctx->opts.vartarget > 0 && k > VARTARGET_BLOCK ? VARTARGET_BLOCK : k;
+    while (1) {
+        ctx->arpackncv = ctx->opts.requestedncv > 0 ? ctx->opts.requestedncv : (2*ctx->numeigs > ctx->numcols ? ctx->numcols : 2*ctx->numeigs);
+        free(singVals);
+        singVals = (double *) malloc( ctx->numeigs * sizeof(double));
+        rightSingVecs = (double *) malloc( (size_t) ctx->numeigs * ctx->numcols * sizeof(double));
+        if (singVals == NULL || rightSingVecs == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+
+        if (ctx->opts.solver == SOLVER_RSVD) {
+            blockSubspaceIteration(ctx, rightSingVecs, singVals, warmVecs, numwarm);
+        } else if (ctx->opts.solver == SOLVER_LANCZOS) {
+            lanczosEigensolve(ctx, rightSingVecs, singVals, warmVecs, numwarm);
+        } else {
+            arpackEigensolve(ctx, rightSingVecs, singVals, warmVecs, numwarm);
+        }
+        free(warmVecs);
+        warmVecs = NULL;
+        if (ctx->opts.vartarget <= 0) {
+            break;
+        }
+
+        // every rank has the singular values, so every rank takes the same decision
+        int kept;
+        captured = singVals[0]*singVals[0];
+        for(kept = 1; kept < ctx->numeigs && captured < ctx->opts.vartarget*totalvar; kept = kept + 1) {
+            captured += singVals[kept]*singVals[kept];
+        }
+        if (captured >= ctx->opts.vartarget*totalvar || ctx->numeigs == k) {
+            if (ctx->mpi_rank == 0) {
+                printf("Keeping %d components, which capture %f of the total variance %g (--vartarget %g%s)\n", kept,
+                       totalvar > 0 ? captured/totalvar : 1., totalvar, ctx->opts.vartarget, captured >= ctx->opts.vartarget*totalvar ? "" : ", not reached within numeigs");
+            }
+            // the leading kept columns of rightSingVecs, in place
+            long rowidx;
+            for(rowidx = 1; rowidx < ctx->numcols && kept < ctx->numeigs; rowidx = rowidx + 1) {
+                memmove(rightSingVecs + rowidx*kept, rightSingVecs + rowidx*ctx->numeigs, kept * sizeof(double));
+            }
+            ctx->numeigs = kept;
+            break;
+        }
+        if (ctx->mpi_rank == 0) {
+            printf("%d components capture %f of the total variance, short of --vartarget %g: starting over with %d\n", ctx->numeigs,
+                   captured/totalvar, ctx->opts.vartarget, 2*ctx->numeigs < k ? 2*ctx->numeigs : k);
+        }
+        // the next attempt starts from this one's vectors, on the ranks where the solver returns them
+        warmVecs = rightSingVecs;
+        numwarm = ctx->numeigs;
+        ctx->numeigs = 2*ctx->numeigs < k ? 2*ctx->numeigs : k;
+    }
+
+	//printf("Performing a broadcast\n");
+    double tcompavstr, tcompavstp;
+	tcompavstr = MPI_Wtime();
+	if (ctx->opts.solver == SOLVER_ARPACK) {
+	    chunkedBcast(rightSingVecs, (long) ctx->numeigs*ctx->numcols, 0, ctx->comm);
+	}
+    phaseAdd(ctx, PHASE_BCAST, MPI_Wtime() - tcompavstr);
+
+    double * AVlocal = (double *) malloc( (size_t) ctx->localrows * ctx->numeigs * sizeof(double));
+    double * Ulocal = (double *) malloc( (size_t) ctx->localrows * ctx->numeigs * sizeof(double));
+    double * VT = (double *) malloc( ctx->numeigs * ctx->numeigs * sizeof(double));
+    double * singvals = (double *) malloc( ctx->numeigs * sizeof(double));
+    if (AVlocal == NULL || Ulocal == NULL || VT == NULL || singvals == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    double tavstr = MPI_Wtime();
+    localMatMatProd(ctx, rightSingVecs, AVlocal, ctx->numeigs);
+	tcompavstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_AV, tcompavstp - tavstr);
+    if (ctx->mpi_rank == 0) {
+		printf("Time to compute AV: %f\n", tcompavstp - tcompavstr);
+    }
+
+    // singular values come back in descending order; each rank keeps its own rows of U
+    // note that the right singular vectors of AV should by definition be the identity 
+    double tsddstr, tsddstp;
+    tsddstr = MPI_Wtime();
+    // on a grid every rank of a grid row holds the same rows of AV, so grid column 0 factors it on its own and hands the
+    // rest of its grid row U, S and VT
+    if (ctx->opts.gridcols == 0) {
+        distributedTallSkinnySVD(ctx, ctx->comm, AVlocal, ctx->localrows, ctx->numeigs, Ulocal, singvals, VT);
+    } else {
+        if (ctx->gridcol == 0) {
+            distributedTallSkinnySVD(ctx, ctx->colcomm, AVlocal, ctx->localrows, ctx->numeigs, Ulocal, singvals, VT);
+        }
+        MPI_Bcast(singvals, ctx->numeigs, MPI_DOUBLE, 0, ctx->rowcomm);
+        MPI_Bcast(VT, ctx->numeigs*ctx->numeigs, MPI_DOUBLE, 0, ctx->rowcomm);
+        chunkedBcast(Ulocal, (long) ctx->localrows*ctx->numeigs, 0, ctx->rowcomm);
+    }
+    tsddstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_SVD, tsddstp - tsddstr);
+    if (ctx->mpi_rank == 0) {
+		printf("Time to compute SVD of AV: %f\n", tsddstp - tsddstr);
+    }
+
+    // every rank has the rotation VT, and rightSingVecs is only numcols-by-numeigs, so V is formed everywhere
+    double * V = (double *) malloc( ctx->numeigs * ctx->numeigs * sizeof(double));
+    double * finalV = (double *) malloc( (size_t) ctx->numcols * ctx->numeigs * sizeof(double));
+    if (V == NULL || finalV == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    mattrans(VT, ctx->numeigs, ctx->numeigs, V);
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, ctx->numcols, ctx->numeigs, ctx->numeigs, 1.0, rightSingVecs, ctx->numeigs, V, ctx->numeigs, 0.0, finalV, ctx->numeigs);
+    if (ctx->mpi_rank == 0) {
+        printvec("top singular values of A\n", singvals, ctx->numeigs);
+        printmat("top left singular vectors of A (rows on rank 0)\n", Ulocal, ctx->localrows, ctx->numeigs);
+        printmat("top right singular vectors of A\n", finalV, ctx->numcols, ctx->numeigs);
+    }
+    if (ctx->opts.streaming && ctx->mpi_rank == 0) {
+        printf("Time spent waiting on streamed panel reads: %f\n", ctx->tstreamwait);
+    }
+
+    result->numeigs = ctx->numeigs;
+    result->numcols = ctx->numcols;
+    result->localrows = ctx->localrows;
+    result->startingrow = ctx->startingrow;
+    result->singvals = singvals;
+    result->V = finalV;
+    result->Ulocal = Ulocal;
+    result->mean = NULL;
+    result->std = NULL;
+    if (centered(ctx)) {
+        result->mean = (double *) malloc( ctx->numcols * sizeof(double));
+        result->std = ctx->opts.scale ? (double *) malloc( ctx->numcols * sizeof(double)) : NULL;
+        if (result->mean == NULL || (ctx->opts.scale && result->std == NULL)) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+        memcpy(result->mean, ctx->colmeans, ctx->numcols * sizeof(double));
+        if (ctx->opts.scale) {
+            memcpy(result->std, ctx->colstds, ctx->numcols * sizeof(double));
+        }
+    }
+
+    free(V);
+    free(AVlocal);
+    free(VT);
+    free(singVals);
+    free(rightSingVecs);
+    if (ctx->opts.commsegments > 1) {
+        free(ctx->AxScratch);
+        free(ctx->gramrequests);
+    }
+}
+
+void pcaProject(const struct PcaResult * result, const double rows[], int numrows, double scores[]) {
+    int k = result->numeigs, n = result->numcols;
+    // with D the inverse standard deviations, ((X - 1*mu')*D)*V = X*(D*V) - 1*(mu'*D*V), so the rows are used as they are
+    double * DV = (double *) malloc( (size_t) n * k * sizeof(double));
+    double * shifts = (double *) malloc( k * sizeof(double));
+    if (DV == NULL || shifts == NULL) {
+        printf("Out of memory in pcaProject\n");
+        exit(-1);
+    }
+    long colidx;
+    int vecidx;
+    for(colidx = 0; colidx < n; colidx = colidx + 1) {
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            DV[colidx*k + vecidx] = result->V[colidx*k + vecidx]/(result->std != NULL ? result->std[colidx] : 1.0);
+        }
+    }
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, numrows, k, n, 1.0, rows, n, DV, k, 0.0, scores, k);
+    if (result->mean != NULL) {
+        cblas_dgemv(CblasRowMajor, CblasTrans, n, k, 1.0, DV, k, result->mean, 1, 0.0, shifts, 1);
+        long rowidx;
+        #pragma omp parallel for private(vecidx) schedule(static)
+        for(rowidx = 0; rowidx < numrows; rowidx = rowidx + 1) {
+            for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+                scores[rowidx*k + vecidx] -= shifts[vecidx];
+            }
+        }
+    }
+    free(DV);
+    free(shifts);
+}
+
+void pcaReadComponents(MPI_Comm pcacomm, const char * fname, int numeigs, struct PcaResult * result) {
+    int rank, header[4]; // numcols, stored components, whether there are /mean and /std
+    MPI_Comm_rank(pcacomm, &rank);
+    hid_t file_id = -1;
+    if (rank == 0) {
+        header[0] = -1;
+        file_id = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id >= 0 && H5Lexists(file_id, "/V", H5P_DEFAULT) > 0 && H5Lexists(file_id, "/S", H5P_DEFAULT) > 0) {
+            hsize_t dims[2];
+            hid_t dataset_id = H5Dopen(file_id, "/V", H5P_DEFAULT);
+            hid_t filespace = H5Dget_space(dataset_id);
+            if (H5Sget_simple_extent_ndims(filespace) == 2) {
+                H5Sget_simple_extent_dims(filespace, dims, NULL);
+                header[0] = dims[0];
+                header[1] = dims[1];
+            }
+            H5Sclose(filespace);
+            H5Dclose(dataset_id);
+            header[2] = H5Lexists(file_id, "/mean", H5P_DEFAULT) > 0;
+            header[3] = H5Lexists(file_id, "/std", H5P_DEFAULT) > 0;
+        }
+    }
+    MPI_Bcast(header, 4, MPI_INT, 0, pcacomm);
+    if (header[0] <= 0 || numeigs <= 0 || numeigs > header[1]) {
+        if (rank == 0) {
+            printf("%s has no /V and /S from a decomposition with at least %d components\n", fname, numeigs);
+        }
+        MPI_Abort(pcacomm, -1);
+    }
+
+    int numcols = header[0], stored = header[1];
+    double * storedV = (double *) malloc( (size_t) numcols * stored * sizeof(double));
+    double * storedS = (double *) malloc( stored * sizeof(double));
+    result->numeigs = numeigs;
+    result->numcols = numcols;
+    result->localrows = 0;
+    result->startingrow = 0;
+    result->singvals = (double *) malloc( numeigs * sizeof(double));
+    result->V = (double *) malloc( (size_t) numcols * numeigs * sizeof(double));
+    result->Ulocal = NULL;
+    result->mean = header[2] ? (double *) malloc( numcols * sizeof(double)) : NULL;
+    result->std = header[3] ? (double *) malloc( numcols * sizeof(double)) : NULL;
+    if (storedV == NULL || storedS == NULL || result->singvals == NULL || result->V == NULL || (header[2] && result->mean == NULL) || (header[3] && result->std == NULL)) {
+        printf("Out of memory on process %d\n", rank);
+        exit(-1);
+    }
+    if (rank == 0) {
+        herr_t status = 0;
+        hid_t dataset_id = H5Dopen(file_id, "/V", H5P_DEFAULT);
+        status |= H5Dread(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, storedV);
+        H5Dclose(dataset_id);
+        dataset_id = H5Dopen(file_id, "/S", H5P_DEFAULT);
+        status |= H5Dread(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, storedS);
+        H5Dclose(dataset_id);
+        if (header[2]) {
+            dataset_id = H5Dopen(file_id, "/mean", H5P_DEFAULT);
+            status |= H5Dread(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, result->mean);
+            H5Dclose(dataset_id);
+        }
+        if (header[3]) {
+            dataset_id = H5Dopen(file_id, "/std", H5P_DEFAULT);
+            status |= H5Dread(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, result->std);
+            H5Dclose(dataset_id);
+        }
+        H5Fclose(file_id);
+        if (status < 0) {
+            printf("Failed to read the components in %s\n", fname);
+            MPI_Abort(pcacomm, -1);
+        }
+    }
+    chunkedBcast(storedV, (long) numcols*stored, 0, pcacomm);
+    MPI_Bcast(storedS, stored, MPI_DOUBLE, 0, pcacomm);
+    if (header[2]) {
+        MPI_Bcast(result->mean, numcols, MPI_DOUBLE, 0, pcacomm);
+    }
+    if (header[3]) {
+        MPI_Bcast(result->std, numcols, MPI_DOUBLE, 0, pcacomm);
+    }
+
+    // the leading numeigs columns of the stored V
+    long colidx;
+    for(colidx = 0; colidx < numcols; colidx = colidx + 1) {
+        memcpy(result->V + colidx*numeigs, storedV + colidx*stored, numeigs * sizeof(double));
+    }
+    memcpy(result->singvals, storedS, numeigs * sizeof(double));
+    free(storedV);
+    free(storedS);
+}
+
+void pcaProjectFile(MPI_Comm pcacomm, const char * componentsfname, const char * infilename, const char * datasetname, long numrows, int numcols, int numeigs, const char * outfname) {
+    struct PcaResult components;
+    pcaReadComponents(pcacomm, componentsfname, numeigs, &components);
+    struct PcaContext * ctx = newContext(pcacomm, infilename, datasetname, numrows, numcols);
+    if (components.numcols != numcols || ctx->opts.sparse || ctx->opts.gridcols > 0) {
+        if (ctx->mpi_rank == 0) {
+            printf("Projection needs components with %d rows and a dense input on a 1D row distribution (got %d rows of V)\n", numcols, components.numcols);
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->mpi_rank == 0) {
+        printf("Projecting %ld x %d rows of %s onto %d components of %s\n", numrows, numcols, infilename, numeigs, componentsfname);
+    }
+
+    // the new rows are only ever needed once, so they are streamed in panels behind the compute, whatever --stream says
+    double treadstr = MPI_Wtime();
+    ctx->opts.streaming = 1;
+    ctx->opts.readmode = READ_INDEPENDENT;
+    partitionMatrix(ctx, ctx->opts.chunkalign);
+    openStreamedInput(ctx);
+    allocateScratch(ctx);
+    phaseAdd(ctx, PHASE_READ, MPI_Wtime() - treadstr);
+    ctx->loaded = 1;
+
+    // localMatMatProd centers and scales the rows on the fly with the stored moments
+    ctx->opts.center = components.mean != NULL;
+    ctx->opts.scale = components.mean != NULL && components.std != NULL;
+    ctx->colmeans = components.mean;
+    ctx->colstds = components.std;
+    double * scores = (double *) malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * numeigs * sizeof(double));
+    if (scores == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    ctx->tstreamwait = 0.;
+    double tprojstr = MPI_Wtime();
+    localMatMatProd(ctx, components.V, scores, numeigs);
+    double tprojstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_AV, tprojstp - tprojstr);
+    ctx->colmeans = NULL;
+    ctx->colstds = NULL;
+    if (ctx->mpi_rank == 0) {
+        printf("Time to project: %f (of which %f waiting on panel reads)\n", tprojstp - tprojstr, ctx->tstreamwait);
+    }
+
+    hsize_t dims[2], offset[2], count[2];
+    hid_t file_id = createOutputFile(ctx, outfname);
+    dims[0] = numrows;
+    dims[1] = numeigs;
+    offset[0] = ctx->startingrow;
+    offset[1] = 0;
+    count[0] = ctx->localrows;
+    count[1] = numeigs;
+    writeDatasetCollective(ctx, file_id, "/scores", 2, dims, ctx->opts.outchunkrows, offset, count, scores);
+    H5Fclose(file_id);
+    double twritestp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_WRITE, twritestp - tprojstp);
+    if (ctx->mpi_rank == 0) {
+        printf("Time to write %s: %f\n", outfname, twritestp - tprojstp);
+    }
+
+    free(scores);
+    pcaFree(ctx);
+    pcaFreeResult(&components);
+}
+
+/* With the old rows A = U*S*V' + 1*mu' (mu = 0 without centering) and the new rows B with column means muB, the scatter of
+   the combined rows about their mean mu2 is that of the rows of M = [S*V'; e'; B - 1*muB'], with e = sqrt(m*p/(m+p))*(muB - mu)
+   (Ross et al., IJCV 77, 2008). M is reduced to the basis W = [V, Q] spanning V, the part of the new rows' range outside it (a
+   randomized sketch of the Gramian of B) and e, and the small SVD of M*W = Ut*St*VT' by the same TSQR as the final step of
+   pcaCompute gives V2 = W*VT(:, 1:k) and S2 = St(1:k). The old rows of U2 are their rows of U rotated by the top of Ut, the new
+   ones come out of Ut directly, both shifted for the move of the mean from mu and muB to mu2 */
+void pcaUpdateFile(MPI_Comm pcacomm, const char * oldfname, const char * infilename, const char * datasetname, long numnewrows, int numcols, int k, const char * outfname) {
+    struct PcaResult old;
+    int rank;
+    MPI_Comm_rank(pcacomm, &rank);
+    pcaReadComponents(pcacomm, oldfname, k, &old);
+    if (old.numcols != numcols || old.std != NULL) {
+        if (rank == 0) {
+            printf("An update needs components with %d rows of V from a run without --scale (got %d rows%s)\n", numcols, old.numcols,
+                   old.std != NULL ? " and standard deviations, which change with every new row" : "");
+        }
+        MPI_Abort(pcacomm, -1);
+    }
+
+    // rows of the old U, read by their owners in parallel; A itself is never read again
+    long oldrows = 0;
+    if (rank == 0) {
+        hid_t file_id = H5Fopen(oldfname, H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id >= 0 && H5Lexists(file_id, "/U", H5P_DEFAULT) > 0) {
+            hsize_t dims[2];
+            hid_t dataset_id = H5Dopen(file_id, "/U", H5P_DEFAULT);
+            hid_t filespace = H5Dget_space(dataset_id);
+            if (H5Sget_simple_extent_ndims(filespace) == 2) {
+                H5Sget_simple_extent_dims(filespace, dims, NULL);
+                oldrows = dims[1] >= (hsize_t) k ? dims[0] : 0;
+            }
+            H5Sclose(filespace);
+            H5Dclose(dataset_id);
+        }
+        if (file_id >= 0) {
+            H5Fclose(file_id);
+        }
+    }
+    MPI_Bcast(&oldrows, 1, MPI_LONG, 0, pcacomm);
+    if (oldrows <= 0) {
+        if (rank == 0) {
+            printf("%s has no /U with at least %d columns\n", oldfname, k);
+        }
+        MPI_Abort(pcacomm, -1);
+    }
+
+    struct PcaContext * ctx = pcaLoad(pcacomm, infilename, datasetname, numnewrows, numcols);
+    if (ctx->opts.gridcols > 0) {
+        if (ctx->mpi_rank == 0) {
+            printf("Updates need the 1D row distribution\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    ctx->numeigs = k;
+    int oldlocalrows;
+    long oldstart;
+    alignedPartition(ctx, oldrows, ctx->mpi_size, ctx->mpi_rank, 1, &oldlocalrows, &oldstart);
+    double treadstr = MPI_Wtime();
+    double * Ulocal = (double *) malloc( (size_t) (oldlocalrows + ctx->localrows > 0 ? oldlocalrows + ctx->localrows : 1) * k * sizeof(double));
+    if (Ulocal == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, MPI_INFO_NULL);
+    hid_t file_id = H5Fopen(oldfname, H5F_ACC_RDONLY, plist_id);
+    hid_t dataset_id = H5Dopen(file_id, "/U", H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset_id);
+    hsize_t offset[2], count[2];
+    offset[0] = oldstart;
+    offset[1] = 0;
+    count[0] = oldlocalrows > 0 ? oldlocalrows : 1;
+    count[1] = k;
+    hid_t memspace = H5Screate_simple(2, count, NULL);
+    if (oldlocalrows > 0) {
+        count[0] = oldlocalrows;
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+    } else {
+        H5Sselect_none(filespace);
+        H5Sselect_none(memspace);
+    }
+    herr_t status = H5Dread(dataset_id, H5T_NATIVE_DOUBLE, memspace, filespace, H5P_DEFAULT, Ulocal);
+    if (status < 0) {
+        printf("Failed to read /U of %s on process %d\n", oldfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+    phaseAdd(ctx, PHASE_READ, MPI_Wtime() - treadstr);
+    if (ctx->mpi_rank == 0) {
+        printf("Updating %d components of %ld rows from %s with %ld new rows of %s\n", k, oldrows, oldfname, ctx->numrows, infilename);
+    }
+
+    // the kernels center the new rows by their own means, whatever --center and --scale say
+    ctx->opts.center = old.mean != NULL;
+    ctx->opts.scale = 0;
+    double weight = 0;
+    if (centered(ctx)) {
+        double tmomentsstr = MPI_Wtime();
+        computeColumnMoments(ctx);
+        phaseAdd(ctx, PHASE_MOMENTS, MPI_Wtime() - tmomentsstr);
+        weight = sqrt((double) oldrows*ctx->numrows/(oldrows + ctx->numrows));
+    }
+
+    // the basis W = [V, Q]: Q spans the new rows' Gramian applied to a random block orthogonal to V, and e
+    double tsketchstr = MPI_Wtime();
+    int extra = centered(ctx) && k < numcols;
+    int sketch = ctx->opts.oversampling < numcols - k - extra ? ctx->opts.oversampling : numcols - k - extra;
+    int w = k + sketch + extra;
+    double * W = (double *) malloc( (size_t) numcols * w * sizeof(double));
+    double * Omega = (double *) malloc( (size_t) numcols * (sketch > 0 ? sketch : 1) * sizeof(double));
+    double * Y = (double *) malloc( (size_t) numcols * (sketch > 0 ? sketch : 1) * sizeof(double));
+    double * coeffs = (double *) malloc( (size_t) k * (sketch > 0 ? sketch : 1) * sizeof(double));
+    double * BlockScratch = (double *) malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * (sketch > 0 ? sketch : 1) * sizeof(double));
+    double * e = (double *) calloc( numcols, sizeof(double));
+    if (W == NULL || Omega == NULL || Y == NULL || coeffs == NULL || BlockScratch == NULL || e == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    long colidx;
+    int vecidx;
+    if (centered(ctx)) {
+        for(colidx = 0; colidx < numcols; colidx = colidx + 1) {
+            e[colidx] = weight*(ctx->colmeans[colidx] - old.mean[colidx]);
+        }
+    }
+    if (sketch > 0 && ctx->opts.sparse) {
+        reserveCsrPartials(ctx, sketch);
+    }
+    if (sketch > 0) {
+        // every rank draws the same block
+        for(colidx = 0; colidx < (long) numcols*sketch; colidx = colidx + 1) {
+            Omega[colidx] = lanczosStartEntry(colidx, 3);
+        }
+        cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, k, sketch, numcols, 1.0, old.V, k, Omega, sketch, 0.0, coeffs, sketch);
+        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, numcols, sketch, k, -1.0, old.V, k, coeffs, sketch, 1.0, Omega, sketch);
+        distributedGramianMatProd(ctx, Omega, Y, BlockScratch, sketch);
+    }
+    // W is replicated, so every rank orthonormalizes its own copy; the Householder QR keeps the span of V in the first k columns
+    for(colidx = 0; colidx < numcols; colidx = colidx + 1) {
+        memcpy(W + colidx*w, old.V + colidx*k, k * sizeof(double));
+        memcpy(W + colidx*w + k, Y + colidx*sketch, sketch * sizeof(double));
+        if (extra) {
+            W[colidx*w + k + sketch] = e[colidx];
+        }
+    }
+    orthonormalize(ctx, W, numcols, w);
+    double tsketchstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_RITZ, tsketchstp - tsketchstr);
+
+    // rank 0 stacks S*V'*W and e'*W on top of its rows of (B - 1*muB')*W
+    int toprows = ctx->mpi_rank == 0 ? k + centered(ctx) : 0;
+    double * Mlocal = (double *) malloc( (size_t) (toprows + ctx->localrows > 0 ? toprows + ctx->localrows : 1) * w * sizeof(double));
+    double * Ut = (double *) malloc( (size_t) (toprows + ctx->localrows > 0 ? toprows + ctx->localrows : 1) * w * sizeof(double));
+    double * St = (double *) malloc( w * sizeof(double));
+    double * VT = (double *) malloc( w * w * sizeof(double));
+    double * Rotation = (double *) malloc( k * k * sizeof(double));
+    double * V2 = (double *) malloc( (size_t) numcols * k * sizeof(double));
+    double * mean2 = centered(ctx) ? (double *) malloc( numcols * sizeof(double)) : NULL;
+    double * shifts = (double *) calloc( 2 * k, sizeof(double));
+    if (Mlocal == NULL || Ut == NULL || St == NULL || VT == NULL || Rotation == NULL || V2 == NULL || (centered(ctx) && mean2 == NULL) || shifts == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    double tavstr = MPI_Wtime();
+    localMatMatProd(ctx, W, Mlocal + (long) toprows*w, w);
+    phaseAdd(ctx, PHASE_AV, MPI_Wtime() - tavstr);
+    if (ctx->mpi_rank == 0) {
+        cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, k, w, numcols, 1.0, old.V, k, W, w, 0.0, Mlocal, w);
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            cblas_dscal(w, old.singvals[vecidx], Mlocal + vecidx*w, 1);
+        }
+        if (centered(ctx)) {
+            cblas_dgemv(CblasRowMajor, CblasTrans, numcols, w, 1.0, W, w, e, 1, 0.0, Mlocal + k*w, 1);
+        }
+    }
+    double tsvdstr = MPI_Wtime();
+    distributedTallSkinnySVD(ctx, ctx->comm, Mlocal, toprows + ctx->localrows, w, Ut, St, VT);
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, numcols, k, w, 1.0, W, w, VT, w, 0.0, V2, k);
+    // the old rows of U turn with the top k-by-k block of Ut, which only rank 0 holds
+    if (ctx->mpi_rank == 0) {
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            memcpy(Rotation + vecidx*k, Ut + (long) vecidx*w, k * sizeof(double));
+        }
+    }
+    MPI_Bcast(Rotation, k*k, MPI_DOUBLE, 0, ctx->comm);
+    double tsvdstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_SVD, tsvdstp - tsvdstr);
+    if (ctx->mpi_rank == 0) {
+        printf("Time to sketch the new rows: %f\n", tsketchstp - tsketchstr);
+        printf("Time to compute the SVD of the %d-column update: %f\n", w, tsvdstp - tsvdstr);
+    }
+
+    // (mu - mu2)'*V2/S2 and (muB - mu2)'*V2/S2 recenter the old and the new rows of U on the combined mean
+    if (centered(ctx)) {
+        for(colidx = 0; colidx < numcols; colidx = colidx + 1) {
+            mean2[colidx] = (oldrows*old.mean[colidx] + ctx->numrows*ctx->colmeans[colidx])/(oldrows + ctx->numrows);
+            e[colidx] = old.mean[colidx] - mean2[colidx];
+        }
+        cblas_dgemv(CblasRowMajor, CblasTrans, numcols, k, 1.0, V2, k, e, 1, 0.0, shifts, 1);
+        for(colidx = 0; colidx < numcols; colidx = colidx + 1) {
+            e[colidx] = ctx->colmeans[colidx] - mean2[colidx];
+        }
+        cblas_dgemv(CblasRowMajor, CblasTrans, numcols, k, 1.0, V2, k, e, 1, 0.0, shifts + k, 1);
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            shifts[vecidx] = St[vecidx] > 0 ? shifts[vecidx]/St[vecidx] : 0;
+            shifts[k + vecidx] = St[vecidx] > 0 ? shifts[k + vecidx]/St[vecidx] : 0;
+        }
+    }
+    double * Unew = Ulocal + (long) oldlocalrows*k;
+    double * Uold = (double *) malloc( (size_t) (oldlocalrows > 0 ? oldlocalrows : 1) * k * sizeof(double));
+    if (Uold == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    memcpy(Uold, Ulocal, (size_t) oldlocalrows * k * sizeof(double));
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, oldlocalrows, k, k, 1.0, Uold, k, Rotation, k, 0.0, Ulocal, k);
+    long rowidx;
+    #pragma omp parallel for private(vecidx) schedule(static)
+    for(rowidx = 0; rowidx < oldlocalrows; rowidx = rowidx + 1) {
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            Ulocal[rowidx*k + vecidx] += shifts[vecidx];
+        }
+    }
+    #pragma omp parallel for private(vecidx) schedule(static)
+    for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            Unew[rowidx*k + vecidx] = Ut[(toprows + rowidx)*w + vecidx] + shifts[k + vecidx];
+        }
+    }
+    if (ctx->mpi_rank == 0) {
+        printvec("top singular values of the updated matrix\n", St, k);
+    }
+
+    // the old rows keep their place and the new ones follow them
+    double twritestr = MPI_Wtime();
+    hsize_t dims[2], blockoffsets[2], blockcounts[2];
+    dims[0] = oldrows + ctx->numrows;
+    dims[1] = k;
+    blockoffsets[0] = oldstart;
+    blockcounts[0] = oldlocalrows;
+    blockoffsets[1] = oldrows + ctx->startingrow;
+    blockcounts[1] = ctx->localrows;
+    file_id = createOutputFile(ctx, outfname);
+    writeRowBlocksCollective(ctx, file_id, "/U", dims, ctx->opts.outchunkrows, 2, blockoffsets, blockcounts, Ulocal);
+    writeComponents(ctx, file_id, St, V2, mean2, NULL);
+    H5Fclose(file_id);
+    double twritestp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_WRITE, twritestp - twritestr);
+    if (ctx->mpi_rank == 0) {
+        printf("Time to write %s: %f\n", outfname, twritestp - twritestr);
+    }
+
+    free(W);
+    free(Omega);
+    free(Y);
+    free(coeffs);
+    free(BlockScratch);
+    free(e);
+    free(Mlocal);
+    free(Ut);
+    free(St);
+    free(VT);
+    free(Rotation);
+    free(V2);
+    free(mean2);
+    free(shifts);
+    free(Uold);
+    free(Ulocal);
+    pcaFree(ctx);
+    pcaFreeResult(&old);
+}
+
+void pcaWriteResult(struct PcaContext * ctx, const struct PcaResult * result, const char * outfname) {
+    ctx->numeigs = result->numeigs;
+    double twritestr = MPI_Wtime();
+    writeOutput(ctx, outfname, result->Ulocal, result->singvals, result->V, result->mean, result->std);
+    double twritestp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_WRITE, twritestp - twritestr);
+    if (ctx->mpi_rank == 0) {
+        printf("Time to write %s: %f\n", outfname, twritestp - twritestr);
+    }
+}
+
+void pcaReport(struct PcaContext * ctx, double totaltime) {
+    writeTimingReport(ctx, ctx->infilename, totaltime);
+}
+
+void pcaResetTimers(struct PcaContext * ctx) {
+    memset(ctx->phaseTimes, 0, sizeof(ctx->phaseTimes));
+    memset(ctx->phaseCalls, 0, sizeof(ctx->phaseCalls));
+    ctx->flopcount = 0.;
+    ctx->bytecount = 0.;
+}
+
+void pcaFreeResult(struct PcaResult * result) {
+    free(result->singvals);
+    free(result->V);
+    free(result->Ulocal);
+    free(result->mean);
+    free(result->std);
+    result->singvals = NULL;
+    result->V = NULL;
+    result->Ulocal = NULL;
+    result->mean = NULL;
+    result->std = NULL;
+}
+
+void pcaFree(struct PcaContext * ctx) {
+    if (ctx->opts.streaming && ctx->loaded) {
+        free(ctx->StreamBuffers[0]);
+        free(ctx->StreamBuffers[1]);
+        free(ctx->StreamX);
+        H5Pclose(ctx->streamdxpl_id);
+        H5Sclose(ctx->streamfilespace);
+        H5Dclose(ctx->streamdataset_id);
+        H5Fclose(ctx->streamfile_id);
+    } else if (ctx->opts.sparse) {
+        free(ctx->CsrRowPtr);
+        free(ctx->CsrColIdx);
+        free(ctx->CsrValues);
+        free(ctx->CsrPartials);
+    } else {
+        free(ctx->opts.singleprecision ? (void *) ctx->AlocalSingle : (void *) ctx->Alocal);
+    }
+    free(ctx->ConvertScratch);
+    free(ctx->XSingle);
+    free(ctx->ThreadScratch);
+    free(ctx->colmeans);
+    free(ctx->colstds);
+    free(ctx->colsumsquares);
+    if (ctx->opts.gridcols > 0) {
+        free(ctx->GridX);
+        free(ctx->GridT);
+        free(ctx->gridcolcounts);
+        free(ctx->gridcoloffsets);
+        MPI_Comm_free(&ctx->rowcomm);
+        MPI_Comm_free(&ctx->colcomm);
+    }
+    free(ctx->infilename);
+    free(ctx->datasetname);
+    free(ctx->opts.reportfname);
+    free(ctx->opts.checkpointfname);
+    free(ctx);
+}
+
+void pcaReadBenchmark(MPI_Comm pcacomm, const char * infilename, const char * datasetname, long numrows, int numcols, int reps) {
+    struct PcaContext * ctx = newContext(pcacomm, infilename, datasetname, numrows, numcols);
+    if (ctx->opts.sparse || reps <= 0) {
+        if (ctx->mpi_rank == 0) {
+            printf("The read benchmark needs a positive number of repetitions and a dense input\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    partitionMatrix(ctx, ctx->opts.chunkalign);
+    readBenchmark(ctx, ctx->infilename, ctx->datasetname, reps);
+    pcaFree(ctx);
+}
+
+struct PcaContext * newContext(MPI_Comm pcacomm, const char * infilename, const char * datasetname, long rows, int cols) {
+    struct PcaContext * ctx = (struct PcaContext *) calloc(1, sizeof(struct PcaContext));
+    if (ctx == NULL) {
+        printf("Out of memory creating a PCA context\n");
+        exit(-1);
+    }
+    ctx->opts = defaultoptions;
+    ctx->opts.reportfname = defaultoptions.reportfname ? strdup(defaultoptions.reportfname) : NULL;
+    ctx->opts.checkpointfname = defaultoptions.checkpointfname ? strdup(defaultoptions.checkpointfname) : NULL;
+    ctx->comm = pcacomm;
+    MPI_Comm_size(pcacomm, &ctx->mpi_size);
+    MPI_Comm_rank(pcacomm, &ctx->mpi_rank);
+    MPI_Query_thread(&ctx->mpi_thread_support);
+    ctx->infilename = strdup(infilename);
+    ctx->datasetname = strdup(datasetname);
+    ctx->numrows = rows; // if you make this smaller than the dataset, the code will transparently ignore the remainder of the matrix
+    ctx->numcols = cols;
+    if (ctx->infilename == NULL || ctx->datasetname == NULL || (defaultoptions.reportfname && ctx->opts.reportfname == NULL)
+        || (defaultoptions.checkpointfname && ctx->opts.checkpointfname == NULL)) {
+        printf("Out of memory creating a PCA context\n");
+        exit(-1);
+    }
+    checkOptions(ctx);
+    return ctx;
+}
+
+int partitionMatrix(struct PcaContext * ctx, int alignonchunks) {
+    // rows of a chunk that straddles two ranks would be read by both
+    int chunkrows = 0;
+    if (alignonchunks && !ctx->opts.sparse) {
+        if (ctx->mpi_rank == 0) {
+            chunkrows = datasetChunkRows(ctx->infilename, ctx->datasetname);
+        }
+        MPI_Bcast(&chunkrows, 1, MPI_INT, 0, ctx->comm);
+        if ((ctx->numrows + chunkrows - 1)/(chunkrows > 0 ? chunkrows : 1) < (ctx->opts.gridcols > 0 ? ctx->opts.gridrows : ctx->mpi_size)) {
+            chunkrows = 0; // fewer chunks than ranks to spread them over
+        }
+    }
+    if (ctx->opts.gridcols > 0) {
+        // row-major grid: the ranks of a grid row hold the same rows of A, split by columns
+        ctx->gridrow = ctx->mpi_rank/ctx->opts.gridcols;
+        ctx->gridcol = ctx->mpi_rank % ctx->opts.gridcols;
+        MPI_Comm_split(ctx->comm, ctx->gridrow, ctx->gridcol, &ctx->rowcomm);
+        MPI_Comm_split(ctx->comm, ctx->gridcol, ctx->gridrow, &ctx->colcomm);
+        alignedPartition(ctx, ctx->numrows, ctx->opts.gridrows, ctx->gridrow, chunkrows, &ctx->localrows, &ctx->startingrow);
+        blockPartition(ctx->numcols, ctx->opts.gridcols, ctx->gridcol, &ctx->localcols, &ctx->startingcol);
+        ctx->gridcolcounts = (int *) malloc( ctx->opts.gridcols * sizeof(int));
+        ctx->gridcoloffsets = (int *) malloc( ctx->opts.gridcols * sizeof(int));
+        if (ctx->gridcolcounts == NULL || ctx->gridcoloffsets == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+        int colblock;
+        for(colblock = 0; colblock < ctx->opts.gridcols; colblock = colblock + 1) {
+            blockPartition(ctx->numcols, ctx->opts.gridcols, colblock, ctx->gridcolcounts + colblock, ctx->gridcoloffsets + colblock);
+        }
+        if (ctx->mpi_rank == 0) {
+            printf("Distributing A over a %d x %d process grid\n", ctx->opts.gridrows, ctx->opts.gridcols);
+        }
+    } else if (ctx->opts.sparse) {
+        sparsePartition(ctx, ctx->infilename, ctx->datasetname);
+        ctx->localcols = ctx->numcols;
+        ctx->startingcol = 0;
+    } else {
+        alignedPartition(ctx, ctx->numrows, ctx->mpi_size, ctx->mpi_rank, chunkrows, &ctx->localrows, &ctx->startingrow);
+        ctx->localcols = ctx->numcols;
+        ctx->startingcol = 0;
+    }
+
+    //printf("Rank %d: assigned %d rows, %ld--%ld\n", mpi_rank, localrows, startingrow, startingrow + localrows - 1);
+    return chunkrows;
+}
+
+void openStreamedInput(struct PcaContext * ctx) {
+    size_t elementsize = ctx->opts.singleprecision ? sizeof(float) : sizeof(double);
+    // the dataset stays open: the rows of Alocal are read back a panel at a time on every pass over the matrix
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, MPI_INFO_NULL);
+    ctx->streamfile_id = H5Fopen(ctx->infilename, H5F_ACC_RDONLY, plist_id);
+    ctx->streamdataset_id = H5Dopen(ctx->streamfile_id, ctx->datasetname, H5P_DEFAULT);
+    ctx->streamfilespace = H5Dget_space(ctx->streamdataset_id);
+    ctx->streamdxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(ctx->streamdxpl_id, H5FD_MPIO_INDEPENDENT);
+    H5Pclose(plist_id);
+    if (ctx->opts.streamrows == 0) {
+        ctx->opts.streamrows = (long) ctx->opts.streammb*1024*1024/(ctx->numcols*elementsize);
+        ctx->opts.streamrows = ctx->opts.streamrows < 1 ? 1 : ctx->opts.streamrows;
+    }
+    if (ctx->opts.streamrows > ctx->localrows) {
+        ctx->opts.streamrows = ctx->localrows > 0 ? ctx->localrows : 1;
+    }
+    ctx->StreamBuffers[0] = malloc( (size_t) ctx->opts.streamrows * ctx->numcols * elementsize);
+    ctx->StreamBuffers[1] = malloc( (size_t) ctx->opts.streamrows * ctx->numcols * elementsize);
+    if (ctx->StreamBuffers[0] == NULL || ctx->StreamBuffers[1] == NULL) {
+        printf("Out of memory in process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->mpi_rank == 0) {
+        printf("Streaming the matrix in panels of %d rows%s\n", ctx->opts.streamrows,
+               ctx->mpi_thread_support >= MPI_THREAD_SERIALIZED ? ", reading the next panel during compute" : "; MPI lacks MPI_THREAD_SERIALIZED, so reads will not overlap compute");
+    }
+}
+
+void allocateScratch(struct PcaContext * ctx) {
+    ctx->ThreadScratch = (double *) malloc( (size_t) omp_get_max_threads() * (ctx->numcols + gramPanelRows(ctx, ctx->numcols)) * sizeof(double));
+    if (ctx->ThreadScratch == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->opts.singleprecision) {
+        ctx->convertrows = CONVERT_BLOCK_MB*1024*1024/(ctx->numcols*sizeof(double));
+        ctx->convertrows = ctx->convertrows < 1 ? 1 : ctx->convertrows;
+        ctx->ConvertScratch = (double *) malloc( (size_t) ctx->convertrows * ctx->numcols * sizeof(double));
+        if (ctx->ConvertScratch == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+    }
+    if (ctx->opts.singleprecision) {
+        ctx->XSingle = (float *) malloc( ctx->numcols * sizeof(float));
+        if (ctx->XSingle == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+    }
+    if (ctx->opts.streaming) {
+        ctx->StreamX = (double *) malloc( ctx->numcols * sizeof(double));
+        if (ctx->StreamX == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+    }
+    if (ctx->opts.gridcols > 0) {
+        ctx->GridX = (double *) malloc( ctx->localcols * sizeof(double));
+        ctx->GridT = (double *) malloc( (ctx->localrows > 0 ? ctx->localrows : 1) * sizeof(double));
+        if (ctx->GridX == NULL || ctx->GridT == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+    }
+}
+
+void syntheticSpectrum(struct PcaContext * ctx, double spectrum[], int signalrank, double decay, double noise) {
+    int idx;
+    for(idx = 0; idx < ctx->numcols; idx = idx + 1) {
+        if (idx < signalrank) {
+            spectrum[idx] = pow(decay, idx);
+        } else {
+            spectrum[idx] = noise*(1 - 0.5*(idx - signalrank)/(ctx->numcols - signalrank));
+        }
+    }
+}
+
+
+
+
+
+// runs the ARPACK reverse communication loop; only rank 0 holds the ARPACK state, the other ranks just take part in the matvecs
+void arpackEigensolve(struct PcaContext * ctx, double rightSingVecs[], double singVals[], const double warmVecs[], int numwarm) {
+    // the extra trailing entry carries ido, so each iteration needs a single broadcast (see shareArpackRequest)
+    double * vector = (double *) malloc( (ctx->numcols + 1) * sizeof(double));
+
+    // initial call to arpack
+    int ido = 0;
+    int ncv = ctx->arpackncv;
+    double tol = ctx->opts.arpacktol;
+    double * resid = (double *) malloc( ctx->numcols * sizeof(double));
+    double * v = (double *) malloc((size_t) ctx->numcols * ncv *sizeof(double));
+    int iparam[11] = {1, 0, 30, 1, 0, 0, 1, 0, 0, 0, 0};
+    iparam[2] = ctx->opts.arpackmaxiter;
+    int ipntr[11];
+    double * workd = (double *) malloc(3*(size_t) ctx->numcols*sizeof(double));
+    int lworkl = ncv*(ncv + 8);
+    double * workl = (double *) malloc(lworkl*sizeof(double));
+    int arpack_info = 0;
+
+    if ( vector == NULL || resid == NULL || v == NULL || workd == NULL || workl == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+
+    char bmat = 'I';
+    char which[3] = "LM";
+
+    /* ARPACK keeps its position in the iteration in SAVEd Fortran locals, so its arrays alone can't be restored.
+       What is checkpointed is v(:,1:nev), the leading Lanczos vectors kept by the last implicit restart, which span the
+       current approximation to the wanted subspace. A resumed run starts dsaupd (info = 1) from their sum, so the first
+       Lanczos cycle recovers that subspace instead of starting from a random vector */
+    double state[CHECKPOINT_STATE_LEN];
+    int resumedmatvecs = 0;
+    double * savedvecs = (double *) malloc((long) ctx->numcols * ctx->numeigs * sizeof(double));
+    if (savedvecs == NULL) {
+        printf("Could not allocate the checkpoint buffer on process %d\n", ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (readCheckpoint(ctx, state, ctx->numeigs, savedvecs, ctx->mpi_rank == 0 ? ctx->numcols : 0, 0, NULL)) {
+        arpack_info = 1;
+        resumedmatvecs = state[0];
+        memset(resid, 0, ctx->numcols * sizeof(double));
+        int vecidx;
+        for(vecidx = 0; vecidx < ctx->numeigs; vecidx = vecidx + 1) {
+            cblas_daxpy(ctx->numcols, 1.0, savedvecs + (long) vecidx*ctx->numcols, 1, resid, 1);
+        }
+    } else if (numwarm > 0 && ctx->mpi_rank == 0) {
+        // the leading Lanczos steps recover the span of the warm vectors, and the random part (about unit norm, its entries have
+        // variance 1/12) lets the Krylov space reach the directions beyond them even when they are nearly exact eigenvectors
+        arpack_info = 1;
+        int rowidx, vecidx;
+        for(rowidx = 0; rowidx < ctx->numcols; rowidx = rowidx + 1) {
+            resid[rowidx] = sqrt(12.0/ctx->numcols)*lanczosStartEntry(rowidx, 0);
+            for(vecidx = 0; vecidx < numwarm; vecidx = vecidx + 1) {
+                resid[rowidx] += warmVecs[(long) rowidx*numwarm + vecidx];
+            }
+        }
+    }
+    free(savedvecs);
+
+    // initialize ARPACK
+    if (ctx->mpi_rank == 0) {
+        printf("Running ARPACK with tol = %g, ncv = %d, maxiter = %d\n", tol, ncv, iparam[2]);
+        dsaupd_(&ido, &bmat, &ctx->numcols, which,
+                &ctx->numeigs, &tol, resid,
+                &ncv, v, &ctx->numcols,
+                iparam, ipntr, workd,
+                workl, &lworkl, &arpack_info);
+        cblas_dcopy(ctx->numcols, workd + ipntr[0] - 1, 1, vector, 1); 
+    }
+    shareArpackRequest(ctx, vector, &ido);
+
+    // keep calling ARPACK until it stops asking for matvecs: ido == 99 means it converged or hit maxiter, anything else is an error reported in arpack_info
+	double tgrammv = 0., grammvstr, grammvstp;
+	double tarpk = 0., arpkstr, arpkstp;
+	while(ido == 1 || ido == -1) {
+        grammvstr = MPI_Wtime();
+        distributedGramianVecProd(ctx, vector);
+        grammvstp = MPI_Wtime();
+        tgrammv += grammvstp - grammvstr;
+        arpkstr = MPI_Wtime();
+        if (ctx->mpi_rank == 0) {
+            double dsaupdstr = MPI_Wtime();
+            cblas_dcopy(ctx->numcols, vector, 1, workd + ipntr[1] - 1, 1); // y = A x
+            if (DEBUG_DISTMATVEC_FLAG) { 
+                printvec("Input vector: ", workd + ipntr[0] - 1, ctx->numcols); 
+                printvec("Output vector: ", workd + ipntr[1] - 1, ctx->numcols);
+            }
+            dsaupd_(&ido, &bmat, &ctx->numcols, which,
+                    &ctx->numeigs, &tol, resid,
+                    &ncv, v, &ctx->numcols,
+                    iparam, ipntr, workd,
+                    workl, &lworkl, &arpack_info);
+            if (ido == 1 || ido == -1) {
+                cblas_dcopy(ctx->numcols, workd + ipntr[0] - 1, 1, vector, 1);
+            }
+            phaseAdd(ctx, PHASE_DSAUPD, MPI_Wtime() - dsaupdstr);
+        }
+        double bcaststr = MPI_Wtime();
+        shareArpackRequest(ctx, vector, &ido);
+        arpkstp = MPI_Wtime();
+        // on the other ranks this includes waiting for rank 0's dsaupd, which the report shows as imbalance
+        phaseAdd(ctx, PHASE_BCAST, arpkstp - bcaststr);
+        tarpk += arpkstp - arpkstr;
+        if (ctx->opts.checkpointfname != NULL && (ido == 1 || ido == -1) && ctx->ngramcalls - ctx->lastcheckpoint >= ctx->opts.checkpointevery) {
+            state[0] = resumedmatvecs + ctx->ngramcalls;
+            state[1] = state[2] = state[3] = 0;
+            writeCheckpoint(ctx, state, ctx->numeigs, v, ctx->mpi_rank == 0 ? ctx->numcols : 0, 0, NULL, 0);
+        }
+	}
+
+    // propagate ARPACK failures to every rank so the job stops instead of postprocessing garbage
+    MPI_Bcast(&arpack_info, 1, MPI_INT, 0, ctx->comm);
+    // 1 (maxiter reached) still leaves the converged Ritz pairs to extract; any other nonzero code, e.g. 3 (no shifts could be
+    // applied), means there are none
+    if ((arpack_info != 0 && arpack_info != 1) || ido != 99) {
+        printf("dsaupd failed with info %d (ido %d) on process %d\n", arpack_info, ido, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+
+    double tallreduceref = timeBlockingAllreduce(ctx, ctx->numcols);
+    double tgramhidden = ctx->ngramcalls*tallreduceref - ctx->tgramexposedcomm;
+	if(ctx->mpi_rank == 0){
+		printf("Time to perfom distributed Gram matrix-vectors: %f\n", tgrammv); 
+        printf("  of which exposed allreduce: %f, local compute and overlapped communication: %f\n", ctx->tgramexposedcomm, ctx->tgramtotal - ctx->tgramexposedcomm);
+        printf("  estimated allreduce time hidden behind compute with %d segments: %f (blocking allreduce reference: %f per matvec)\n",
+               ctx->opts.commsegments, tgramhidden > 0 ? tgramhidden : 0, tallreduceref);
+		printf("Time spend in arpack: %f\n", tarpk); 
+        if (arpack_info == 1) {
+            printf("ARPACK hit maxiter = %d before converging; only %d of %d eigenvalues converged\n", ctx->opts.arpackmaxiter, iparam[4], ctx->numeigs);
+        }
+		printf("Used %d matrix-vector products and %d restarts to converge to %d eigenvalues\n", resumedmatvecs + iparam[8], iparam[2], iparam[4]);
+        if (resumedmatvecs > 0) {
+            printf("  of which %d before the checkpoint this run resumed from\n", resumedmatvecs);
+        }
+	}
+	
+
+    if (ctx->mpi_rank == 0) {
+        double trtzstr = MPI_Wtime();
+
+        int rvec = 1; // compute Ritz vectors
+        char HowMny = 'A';
+		//printf("Changed select dim from numeigs to ncv\n");
+        int * select = (int * ) malloc(ncv * sizeof(int));
+        double sigma = 0;
+    	
+        // eigenvalues and eigenvectors are returned in ascending order
+        // eigenvectors are returned in column major form
+        double * svtranspose = (double *) malloc( (size_t) ctx->numeigs * ctx->numcols * sizeof(double));
+        //printf("Calling dseupd_ from rank 0\n");
+		if(svtranspose == NULL || select == NULL)
+        	printf("Uh Oh, svtranspose is NULL\n");
+			
+		dseupd_(&rvec, &HowMny, select,
+                singVals, svtranspose, &ctx->numcols,
+                &sigma, &bmat, &ctx->numcols,
+                which, &ctx->numeigs, &tol, 
+                resid, &ncv, v,
+                &ctx->numcols, iparam, ipntr,
+                workd, workl, 
+                &lworkl, &arpack_info);
+        if (arpack_info != 0) {
+            printf("dseupd failed with info %d on process %d\n", arpack_info, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+
+        //printf("Calling mattrans from rank 0\n");
+        mattrans(svtranspose, ctx->numeigs, ctx->numcols, rightSingVecs);
+        //printf("Calling flipcolslr from rank 0\n");
+        flipcolslr(rightSingVecs, ctx->numcols, ctx->numeigs);
+
+        // the eigenvalues of A'*A are also ascending
+        int idx;
+        for(idx = 0; idx < ctx->numeigs/2; idx = idx + 1) {
+            double swap = singVals[idx];
+            singVals[idx] = singVals[ctx->numeigs - 1 - idx];
+            singVals[ctx->numeigs - 1 - idx] = swap;
+        }
+        for(idx = 0; idx < ctx->numeigs; idx = idx + 1) {
+            singVals[idx] = singVals[idx] > 0 ? sqrt(singVals[idx]) : 0;
+        }
+        //printmat("right singular vectors (in descending order left to right)\n", rightSingVecs, numcols, numeigs);
+		double trtzstp = MPI_Wtime();
+        phaseAdd(ctx, PHASE_RITZ, trtzstp - trtzstr);
+		printf("Time to compute Ritz vectors: %f\n", trtzstp - trtzstr);
+        free(svtranspose); 
+        free(select);
+    }
+    MPI_Bcast(singVals, ctx->numeigs, MPI_DOUBLE, 0, ctx->comm);
+    free(vector);
+    free(resid);
+    free(v);
+    free(workd);
+    free(workl);
+}
+
+// randomized subspace iteration (Halko, Martinsson, Tropp) against the Gramian A'*A:
+// each iteration is one BLAS-3 pass over Alocal and one allreduce of numcols*blocksize doubles,
+// instead of one memory-bound matvec and allreduce per ARPACK iteration
+void blockSubspaceIteration(struct PcaContext * ctx, double rightSingVecs[], double singVals[], const double warmVecs[], int numwarm) {
+    int blocksize = ctx->numeigs + ctx->opts.oversampling > ctx->numcols ? ctx->numcols : ctx->numeigs + ctx->opts.oversampling;
+    double * Q = (double *) malloc( (size_t) ctx->numcols * blocksize * sizeof(double));
+    double * Y = (double *) malloc( (size_t) ctx->numcols * blocksize * sizeof(double));
+    double * BlockScratch = (double *) malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * blocksize * sizeof(double));
+    double * B = (double *) malloc( blocksize * blocksize * sizeof(double));
+    double * eigvals = (double *) malloc( blocksize * sizeof(double));
+
+    if (Q == NULL || Y == NULL || BlockScratch == NULL || B == NULL || eigvals == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->opts.sparse) {
+        reserveCsrPartials(ctx, blocksize);
+    }
+
+    // gaussian starting block (Box-Muller on the generator of the Lanczos start), which every rank draws identically without
+    // a broadcast or touching the caller's rand() state; warm vectors replace its leading columns
+    long idx;
+    for(idx = 0; idx < (long) ctx->numcols*blocksize; idx = idx + 1) {
+        double u1 = 0.5 - lanczosStartEntry(2*idx, 0); // in (0, 1]
+        double u2 = 0.5 + lanczosStartEntry(2*idx + 1, 0);
+        Q[idx] = sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+    }
+    for(idx = 0; idx < ctx->numcols && numwarm > 0; idx = idx + 1) {
+        memcpy(Q + idx*blocksize, warmVecs + idx*numwarm, numwarm * sizeof(double));
+    }
+    // Q and Y are replicated, so every rank orthonormalizes its own copy rather than paying for a broadcast
+    orthonormalize(ctx, Q, ctx->numcols, blocksize);
+
+    double tgrammm = 0., grammmstr;
+    int iter;
+    for(iter = 0; iter <= ctx->opts.poweriters; iter = iter + 1) {
+        grammmstr = MPI_Wtime();
+        distributedGramianMatProd(ctx, Q, Y, BlockScratch, blocksize);
+        tgrammm += MPI_Wtime() - grammmstr;
+        if (iter < ctx->opts.poweriters) {
+            double orthstr = MPI_Wtime();
+            cblas_dcopy(ctx->numcols*blocksize, Y, 1, Q, 1);
+            orthonormalize(ctx, Q, ctx->numcols, blocksize);
+            phaseAdd(ctx, PHASE_RITZ, MPI_Wtime() - orthstr);
+        }
+    }
+
+    // Rayleigh-Ritz: the eigenvectors of Q'*(A'*A)*Q rotate Q onto the approximate right singular vectors
+    double trtzstr = MPI_Wtime();
+    cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, blocksize, blocksize, ctx->numcols, 1.0, Q, blocksize, Y, blocksize, 0.0, B, blocksize);
+    int info = LAPACKE_dsyev(LAPACK_ROW_MAJOR, 'V', 'U', blocksize, B, blocksize, eigvals);
+    if (info != 0) {
+        printf("dsyev failed with info %d on process %d\n", info, ctx->mpi_rank);
+        exit(-1);
+    }
+
+    // dsyev returns its eigenvalues in ascending order, so the top numeigs eigenvectors are the last columns of B
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, ctx->numcols, ctx->numeigs, blocksize, 1.0, Q, blocksize, B + (blocksize - ctx->numeigs), blocksize, 0.0, rightSingVecs, ctx->numeigs);
+    flipcolslr(rightSingVecs, ctx->numcols, ctx->numeigs);
+    for(idx = 0; idx < ctx->numeigs; idx = idx + 1) {
+        double eigval = eigvals[blocksize - 1 - idx];
+        singVals[idx] = eigval > 0 ? sqrt(eigval) : 0;
+    }
+    double trtzstp = MPI_Wtime();
+    phaseAdd(ctx, PHASE_RITZ, trtzstp - trtzstr);
+
+    if (ctx->mpi_rank == 0) {
+        printf("Used %d Gram block products with %d vectors (%d power iterations)\n", ctx->opts.poweriters + 1, blocksize, ctx->opts.poweriters);
+        printf("Time to perfom distributed Gram matrix-matrix products: %f\n", tgrammm);
+        printf("Time to compute Ritz vectors: %f\n", trtzstp - trtzstr);
+        printvec("top singular values of A (subspace iteration estimate)\n", singVals, ctx->numeigs);
+    }
+
+    free(Q);
+    free(Y);
+    free(BlockScratch);
+    free(B);
+    free(eigvals);
+}
+
+/* Thick-restart Lanczos (Wu and Simon, SIAM J. Matrix Anal. Appl. 22, 2000). Each cycle extends the basis to ncv vectors
+   with full reorthogonalization, takes the Ritz pairs of the projected matrix T, and restarts from the top
+   k = nev + (ncv - nev)/2 Ritz vectors plus the last residual direction, which turns T into an arrowhead matrix whose
+   couplings are beta*(last row of the Ritz vectors). Basis vectors are split into segments over the ranks, so the dot
+   products of the orthogonalization are the only reductions besides the matvec, and T is formed identically on every
+   rank from reduced quantities, so the Ritz step needs no broadcast. */
+void lanczosEigensolve(struct PcaContext * ctx, double rightSingVecs[], double singVals[], const double warmVecs[], int numwarm) {
+    int ncv = ctx->arpackncv, nev = ctx->numeigs;
+    int * segcounts = (int *) malloc( ctx->mpi_size * sizeof(int));
+    int * segoffsets = (int *) malloc( ctx->mpi_size * sizeof(int));
+    if (segcounts == NULL || segoffsets == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    int rank;
+    for(rank = 0; rank < ctx->mpi_size; rank = rank + 1) {
+        blockPartition(ctx->numcols, ctx->mpi_size, rank, segcounts + rank, segoffsets + rank);
+    }
+    int segrows = segcounts[ctx->mpi_rank], segstart = segoffsets[ctx->mpi_rank];
+    long seglen = segrows > 0 ? segrows : 1; // distance between basis vectors in V, kept positive for the BLAS leading dimensions
+
+    double * V = (double *) malloc( (ncv + 1) * seglen * sizeof(double)); // basis vector j is V + j*seglen
+    double * Vnew = (double *) malloc( ncv * seglen * sizeof(double));
+    double * T = (double *) calloc( ncv * ncv, sizeof(double));
+    double * Y = (double *) malloc( ncv * ncv * sizeof(double));
+    double * Ysel = (double *) malloc( ncv * ncv * sizeof(double));
+    double * theta = (double *) malloc( ncv * sizeof(double));
+    double * coeffs = (double *) malloc( (2 * ncv + 3) * sizeof(double));
+    double * X = (double *) malloc( ctx->numcols * sizeof(double));
+    if (V == NULL || Vnew == NULL || T == NULL || Y == NULL || Ysel == NULL || theta == NULL || coeffs == NULL || X == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->mpi_rank == 0) {
+        printf("Running distributed thick-restart Lanczos with tol = %g, ncv = %d, maxiter = %d\n", ctx->opts.arpacktol, ncv, ctx->opts.arpackmaxiter);
+    }
+
+    int rowidx, vecidx, j, k = 0, restart, firstrestart = 0, nconv = 0, numrestarts = 0, resumedmatvecs = 0;
+    double state[CHECKPOINT_STATE_LEN];
+    // checkpoints are taken right after a thick restart, when the state is the k Ritz vectors, the residual direction and T
+    if (readCheckpoint(ctx, state, ncv + 1, V, segrows, segstart, T)) {
+        resumedmatvecs = state[0];
+        firstrestart = state[1];
+        k = state[2];
+        numrestarts = state[3];
+        if (firstrestart >= ctx->opts.arpackmaxiter) {
+            if (ctx->mpi_rank == 0) {
+                printf("The checkpoint was taken after %d restarts, resume with --maxiter larger than that\n", firstrestart);
+            }
+            MPI_Abort(ctx->comm, -1);
+        }
+    } else if (numwarm > 0) {
+        k = lanczosWarmStart(ctx, warmVecs, numwarm, ncv, V, seglen, segrows, segstart, T);
+    } else {
+        for(rowidx = 0; rowidx < segrows; rowidx = rowidx + 1) {
+            V[rowidx] = lanczosStartEntry(segstart + rowidx, 0);
+        }
+        double startnorm = lanczosOrthogonalize(ctx, V, 0, seglen, segrows, V, coeffs);
+        cblas_dscal(segrows, 1/startnorm, V, 1);
+    }
+
+    // the Ritz pairs of the starting T, so Y and theta hold the current state whichever way the loop ends
+    cblas_dcopy(ncv*ncv, T, 1, Y, 1);
+    if (LAPACKE_dsyev(LAPACK_ROW_MAJOR, 'V', 'U', ncv, Y, ncv, theta) != 0) {
+        printf("dsyev failed on process %d\n", ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+
+    double betam = 0., teigstart, eps23 = pow(2.220446049250313e-16, 2.0/3.0);
+    for(restart = firstrestart; restart < ctx->opts.arpackmaxiter; restart = restart + 1) {
+        for(j = k; j < ncv; j = j + 1) {
+            double * w = V + (j + 1)*seglen;
+            segmentGramianVecProd(ctx, V + j*seglen, w, segcounts, segoffsets, X);
+            double orthstart = MPI_Wtime();
+            double beta = lanczosOrthogonalize(ctx, V, j + 1, seglen, segrows, w, coeffs);
+            T[j*ncv + j] = coeffs[j];
+            // an invariant subspace was found: carry on from a fresh direction orthogonal to the basis, decoupled from T
+            int seed = 1;
+            while (beta <= 1e-12*fabs(coeffs[j]) && seed < 10) {
+                for(rowidx = 0; rowidx < segrows; rowidx = rowidx + 1) {
+                    w[rowidx] = lanczosStartEntry(segstart + rowidx, restart*ncv + j + seed);
+                }
+                double newnorm = lanczosOrthogonalize(ctx, V, j + 1, seglen, segrows, w, coeffs);
+                cblas_dscal(segrows, 1/newnorm, w, 1);
+                beta = 0;
+                seed = newnorm > 1e-8 ? 10 : seed + 1;
+            }
+            if (beta > 0) {
+                cblas_dscal(segrows, 1/beta, w, 1);
+            }
+            if (j + 1 < ncv) {
+                T[j*ncv + j + 1] = beta;
+                T[(j + 1)*ncv + j] = beta;
+            } else {
+                betam = beta;
+            }
+            phaseAdd(ctx, PHASE_ORTH, MPI_Wtime() - orthstart);
+        }
+
+        // Ritz pairs of T, in ascending order; the residual norm of Ritz pair i is betam*|Y(ncv-1, i)|
+        teigstart = MPI_Wtime();
+        cblas_dcopy(ncv*ncv, T, 1, Y, 1);
+        int info = LAPACKE_dsyev(LAPACK_ROW_MAJOR, 'V', 'U', ncv, Y, ncv, theta);
+        if (info != 0) {
+            printf("dsyev failed with info %d on process %d\n", info, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+        nconv = 0;
+        for(vecidx = 0; vecidx < nev; vecidx = vecidx + 1) {
+            double ritzval = theta[ncv - 1 - vecidx];
+            double resnorm = fabs(betam*Y[(ncv - 1)*ncv + ncv - 1 - vecidx]);
+            if (resnorm <= ctx->opts.arpacktol*(fabs(ritzval) > eps23 ? fabs(ritzval) : eps23)) {
+                nconv = nconv + 1;
+            }
+        }
+        if (nconv == nev || restart + 1 == ctx->opts.arpackmaxiter) {
+            phaseAdd(ctx, PHASE_RITZ, MPI_Wtime() - teigstart);
+            break;
+        }
+
+        // thick restart: V(:, 0:k) <- V*Y(:, top k), V(:, k) <- the residual direction, T <- diag(theta) bordered by the couplings
+        k = nev + (ncv - nev)/2;
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            for(j = 0; j < ncv; j = j + 1) {
+                Ysel[vecidx*ncv + j] = Y[j*ncv + ncv - 1 - vecidx];
+            }
+        }
+        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, k, segrows, ncv, 1.0, Ysel, ncv, V, seglen, 0.0, Vnew, seglen);
+        cblas_dcopy(k*seglen, Vnew, 1, V, 1);
+        cblas_dcopy(seglen, V + ncv*seglen, 1, V + k*seglen, 1);
+        memset(T, 0, ncv * ncv * sizeof(double));
+        for(vecidx = 0; vecidx < k; vecidx = vecidx + 1) {
+            T[vecidx*ncv + vecidx] = theta[ncv - 1 - vecidx];
+            T[vecidx*ncv + k] = betam*Ysel[vecidx*ncv + ncv - 1];
+            T[k*ncv + vecidx] = T[vecidx*ncv + k];
+        }
+        numrestarts = numrestarts + 1;
+        phaseAdd(ctx, PHASE_RITZ, MPI_Wtime() - teigstart);
+        if (ctx->opts.checkpointfname != NULL && ctx->ngramcalls - ctx->lastcheckpoint >= ctx->opts.checkpointevery) {
+            state[0] = resumedmatvecs + ctx->ngramcalls;
+            state[1] = restart + 1;
+            state[2] = k;
+            state[3] = numrestarts;
+            writeCheckpoint(ctx, state, k + 1, V, segrows, segstart, T, ncv);
+        }
+    }
+
+    // Ritz vectors in descending order: this rank's segrows-by-nev block, then every rank's blocks stacked into rightSingVecs
+    teigstart = MPI_Wtime();
+    for(vecidx = 0; vecidx < nev; vecidx = vecidx + 1) {
+        for(j = 0; j < ncv; j = j + 1) {
+            Ysel[j*nev + vecidx] = Y[j*ncv + ncv - 1 - vecidx];
+        }
+        singVals[vecidx] = theta[ncv - 1 - vecidx] > 0 ? sqrt(theta[ncv - 1 - vecidx]) : 0;
+    }
+    cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, segrows, nev, ncv, 1.0, V, seglen, Ysel, nev, 0.0, Vnew, nev);
+    // gathered in units of whole rows, so the counts and displacements stay row counts however large numcols*nev gets
+    MPI_Datatype ritzrow;
+    MPI_Type_contiguous(nev, MPI_DOUBLE, &ritzrow);
+    MPI_Type_commit(&ritzrow);
+    MPI_Allgatherv(Vnew, segrows, ritzrow, rightSingVecs, segcounts, segoffsets, ritzrow, ctx->comm);
+    MPI_Type_free(&ritzrow);
+    phaseAdd(ctx, PHASE_RITZ, MPI_Wtime() - teigstart);
+
+    if (ctx->mpi_rank == 0) {
+        printf("Time to perfom distributed Gram matrix-vectors: %f\n", ctx->tgramtotal);
+        printf("  of which exposed allgather and reduce-scatter: %f\n", ctx->tgramexposedcomm);
+        printf("Time to orthogonalize the Lanczos basis: %f\n", ctx->phaseTimes[PHASE_ORTH]);
+        if (nconv < nev) {
+            printf("Lanczos hit maxiter = %d before converging; only %d of %d eigenvalues converged\n", ctx->opts.arpackmaxiter, nconv, nev);
+        }
+        printf("Used %d matrix-vector products and %d restarts to converge to %d eigenvalues\n", resumedmatvecs + ctx->ngramcalls, numrestarts, nconv);
+        if (resumedmatvecs > 0) {
+            printf("  of which %d before the checkpoint this run resumed from\n", resumedmatvecs);
+        }
+    }
+
+    free(segcounts);
+    free(segoffsets);
+    free(V);
+    free(Vnew);
+    free(T);
+    free(Y);
+    free(Ysel);
+    free(theta);
+    free(coeffs);
+    free(X);
+}
+
+double lanczosOrthogonalize(struct PcaContext * ctx, double V[], int numbasis, long seglen, int segrows, double w[], double coeffs[]) {
+    double * correction = coeffs + numbasis;
+    int idx;
+    // a rank with an empty segment still takes part in the reductions, and BLAS leaves the outputs of an empty product untouched
+    memset(coeffs, 0, (2 * numbasis + 1) * sizeof(double));
+    if (numbasis > 0) {
+        cblas_dgemv(CblasRowMajor, CblasNoTrans, numbasis, segrows, 1.0, V, seglen, w, 1, 0.0, coeffs, 1);
+        MPI_Allreduce(MPI_IN_PLACE, coeffs, numbasis, MPI_DOUBLE, MPI_SUM, ctx->comm);
+        cblas_dgemv(CblasRowMajor, CblasTrans, numbasis, segrows, -1.0, V, seglen, coeffs, 1, 1.0, w, 1);
+    }
+    // second pass, which also reduces the squared norm of w; what is removed is orthogonal to what is left, so the norms subtract
+    if (numbasis > 0) {
+        cblas_dgemv(CblasRowMajor, CblasNoTrans, numbasis, segrows, 1.0, V, seglen, w, 1, 0.0, correction, 1);
+    }
+    correction[numbasis] = cblas_ddot(segrows, w, 1, w, 1);
+    MPI_Allreduce(MPI_IN_PLACE, correction, numbasis + 1, MPI_DOUBLE, MPI_SUM, ctx->comm);
+    double normsq = correction[numbasis];
+    if (numbasis > 0) {
+        cblas_dgemv(CblasRowMajor, CblasTrans, numbasis, segrows, -1.0, V, seglen, correction, 1, 1.0, w, 1);
+    }
+    for(idx = 0; idx < numbasis; idx = idx + 1) {
+        coeffs[idx] += correction[idx];
+        normsq -= correction[idx]*correction[idx];
+    }
+    return normsq > 0 ? sqrt(normsq) : 0;
+}
+
+/* With W the orthonormalized warm vectors, one block product gives A'*A*W, the Rayleigh-Ritz pairs (theta, Y = W*U) of W'*A'*A*W
+   and the residuals R = A'*A*Y - Y*diag(theta), which are orthogonal to Y. For Ritz vectors of an earlier Lanczos basis every
+   residual is a multiple of that basis' last vector, so R = r*s' up to rounding, and [Y r] with T = diag(theta) bordered by s is
+   exactly the state a thick restart leaves. The work is on replicated numcols-by-numwarm matrices, identical on every rank */
+int lanczosWarmStart(struct PcaContext * ctx, const double warmVecs[], int numwarm, int ncv, double V[], long seglen, int segrows, int segstart, double T[]) {
+    double * W = (double *) malloc( (size_t) ctx->numcols * numwarm * sizeof(double));
+    double * Z = (double *) malloc( (size_t) ctx->numcols * numwarm * sizeof(double));
+    double * Y = (double *) malloc( (size_t) ctx->numcols * numwarm * sizeof(double));
+    double * BlockScratch = (double *) malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * numwarm * sizeof(double));
+    double * H = (double *) malloc( numwarm * numwarm * sizeof(double));
+    double * theta = (double *) malloc( numwarm * sizeof(double));
+    double * r = (double *) malloc( ctx->numcols * sizeof(double));
+    double * s = (double *) malloc( numwarm * sizeof(double));
+    if (W == NULL || Z == NULL || Y == NULL || BlockScratch == NULL || H == NULL || theta == NULL || r == NULL || s == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->opts.sparse) {
+        reserveCsrPartials(ctx, numwarm);
+    }
+    cblas_dcopy(ctx->numcols*numwarm, warmVecs, 1, W, 1);
+    orthonormalize(ctx, W, ctx->numcols, numwarm);
+    distributedGramianMatProd(ctx, W, Z, BlockScratch, numwarm);
+    cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, numwarm, numwarm, ctx->numcols, 1.0, W, numwarm, Z, numwarm, 0.0, H, numwarm);
+    int info = LAPACKE_dsyev(LAPACK_ROW_MAJOR, 'V', 'U', numwarm, H, numwarm, theta);
+    if (info != 0) {
+        printf("dsyev failed with info %d on process %d\n", info, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    // Y = W*U, and Z*U - Y*diag(theta) into W, whose column of largest norm is the residual direction
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, ctx->numcols, numwarm, numwarm, 1.0, W, numwarm, H, numwarm, 0.0, Y, numwarm);
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, ctx->numcols, numwarm, numwarm, 1.0, Z, numwarm, H, numwarm, 0.0, W, numwarm);
+    long rowidx;
+    int vecidx, largest = 0;
+    double largestnorm = -1;
+    for(vecidx = 0; vecidx < numwarm; vecidx = vecidx + 1) {
+        cblas_daxpy(ctx->numcols, -theta[vecidx], Y + vecidx, numwarm, W + vecidx, numwarm);
+        double colnorm = cblas_dnrm2(ctx->numcols, W + vecidx, numwarm);
+        if (colnorm > largestnorm) {
+            largestnorm = colnorm;
+            largest = vecidx;
+        }
+    }
+    cblas_dcopy(ctx->numcols, W + largest, numwarm, r, 1);
+    // two passes of Gram-Schmidt against Y; if the warm vectors span an invariant subspace, any direction orthogonal to it will do
+    int seed = 0;
+    double rnorm = 0;
+    while (rnorm <= 1e-12*(fabs(theta[numwarm - 1]) > 1 ? fabs(theta[numwarm - 1]) : 1) && seed < 10) {
+        if (seed > 0) {
+            for(rowidx = 0; rowidx < ctx->numcols; rowidx = rowidx + 1) {
+                r[rowidx] = lanczosStartEntry(rowidx, seed);
+            }
+        }
+        int pass;
+        for(pass = 0; pass < 2; pass = pass + 1) {
+            cblas_dgemv(CblasRowMajor, CblasTrans, ctx->numcols, numwarm, 1.0, Y, numwarm, r, 1, 0.0, s, 1);
+            cblas_dgemv(CblasRowMajor, CblasNoTrans, ctx->numcols, numwarm, -1.0, Y, numwarm, s, 1, 1.0, r, 1);
+        }
+        rnorm = cblas_dnrm2(ctx->numcols, r, 1);
+        seed = seed + 1;
+    }
+    cblas_dscal(ctx->numcols, 1/rnorm, r, 1);
+    cblas_dgemv(CblasRowMajor, CblasTrans, ctx->numcols, numwarm, 1.0, W, numwarm, r, 1, 0.0, s, 1);
+
+    // descending order, as after a thick restart
+    memset(T, 0, ncv * ncv * sizeof(double));
+    for(vecidx = 0; vecidx < numwarm; vecidx = vecidx + 1) {
+        int col = numwarm - 1 - vecidx;
+        for(rowidx = 0; rowidx < segrows; rowidx = rowidx + 1) {
+            V[vecidx*seglen + rowidx] = Y[(segstart + rowidx)*numwarm + col];
+        }
+        T[vecidx*ncv + vecidx] = theta[col];
+        T[vecidx*ncv + numwarm] = s[col];
+        T[numwarm*ncv + vecidx] = s[col];
+    }
+    cblas_dcopy(segrows, r + segstart, 1, V + numwarm*seglen, 1);
+    if (ctx->mpi_rank == 0) {
+        printf("Warm-started Lanczos from the %d vectors of the previous attempt with one Gram block product\n", numwarm);
+    }
+
+    free(W);
+    free(Z);
+    free(Y);
+    free(BlockScratch);
+    free(H);
+    free(theta);
+    free(r);
+    free(s);
+    return numwarm;
+}
+
+double lanczosStartEntry(long globalidx, int seed) {
+    unsigned long long state = (globalidx + 1)*0x9E3779B97F4A7C15ULL + seed*0xBF58476D1CE4E5B9ULL;
+    state ^= state >> 30;
+    state *= 0xBF58476D1CE4E5B9ULL;
+    state ^= state >> 27;
+    state *= 0x94D049BB133111EBULL;
+    state ^= state >> 31;
+    return (state >> 11)*(1.0/9007199254740992.0) - 0.5;
+}
+
+// computes A^T*A*v and stores back in v
+// with a single segment, the fused kernel reads Alocal once and the sum is reduced in place with a blocking allreduce;
+// with more, A*v is formed first and A^T*(A*v) is then computed one column segment at a time, starting the allreduce of
+// each segment as soon as it is done so communication overlaps the remaining compute at the price of a second sweep over Alocal
+void distributedGramianVecProd(struct PcaContext * ctx, double v[]) {
+    double gramstart = MPI_Wtime(), commstart, shift;
+    // on a grid only rank 0 holds v, and the correction only needs v, mu and the column scales
+    int holdsv = ctx->opts.gridcols == 0 || ctx->mpi_rank == 0;
+    if (centered(ctx) && holdsv) {
+        centeringInput(ctx, v, 1, v, &shift);
+    }
+    if (ctx->opts.gridcols > 0) {
+        double commtime = gridGramianVecProd(ctx, v);
+        // the grid product interleaves its reductions with the compute; charge their total as if it came last
+        commstart = MPI_Wtime() - commtime;
+    } else if (ctx->opts.streaming || ctx->opts.commsegments == 1) {
+        localGramianVecProd(ctx, v);
+        commstart = MPI_Wtime();
+        MPI_Allreduce(MPI_IN_PLACE, v, ctx->numcols, MPI_DOUBLE, MPI_SUM, ctx->comm);
+    } else {
+        int segidx, flag;
+        multiplyAVec(ctx->Alocal, v, ctx->AxScratch, ctx->localrows, ctx->numcols);
+        for(segidx = 0; segidx < ctx->opts.commsegments; segidx = segidx + 1) {
+            int firstcol = (long) ctx->numcols*segidx/ctx->opts.commsegments;
+            int lastcol = (long) ctx->numcols*(segidx + 1)/ctx->opts.commsegments;
+            multiplyATransVecCols(ctx, ctx->Alocal, ctx->AxScratch, v + firstcol, ctx->localrows, ctx->numcols, firstcol, lastcol);
+            MPI_Iallreduce(MPI_IN_PLACE, v + firstcol, lastcol - firstcol, MPI_DOUBLE, MPI_SUM, ctx->comm, ctx->gramrequests + segidx);
+            // poke the MPI progress engine so the reductions already in flight advance while we compute
+            MPI_Testall(segidx + 1, ctx->gramrequests, &flag, MPI_STATUSES_IGNORE);
+        }
+        commstart = MPI_Wtime();
+        MPI_Waitall(ctx->opts.commsegments, ctx->gramrequests, MPI_STATUSES_IGNORE);
+    }
+    if (centered(ctx) && holdsv) {
+        centerGramianOutput(ctx, v, 1, &shift);
+    }
+    double gramstop = MPI_Wtime();
+    ctx->tgramexposedcomm += gramstop - commstart;
+    ctx->tgramtotal += gramstop - gramstart;
+    ctx->ngramcalls = ctx->ngramcalls + 1;
+    phaseAdd(ctx, PHASE_GRAM_COMPUTE, commstart - gramstart);
+    phaseAdd(ctx, PHASE_GRAM_ALLREDUCE, gramstop - commstart);
+    countMatrixPass(ctx, 4, 1, ctx->opts.commsegments > 1 ? 2 : 1);
+}
+
+void localGramianVecProd(struct PcaContext * ctx, double v[]) {
+    if (ctx->opts.streaming) {
+        struct GramianVecPanelArgs args;
+        cblas_dcopy(ctx->numcols, v, 1, ctx->StreamX, 1);
+        memset(v, 0, ctx->numcols * sizeof(double));
+        args.x = ctx->StreamX;
+        args.y = v;
+        forEachRowPanel(ctx, gramianVecPanel, gramianVecPanelSingle, &args);
+    } else if (ctx->opts.singleprecision) {
+        multiplyGramianVecSingle(ctx, ctx->AlocalSingle, v, v, ctx->localrows, ctx->numcols, 0);
+    } else if (ctx->opts.sparse) {
+        multiplyGramianVecCsr(ctx, v, v, 0);
+    } else {
+        multiplyGramianVec(ctx, ctx->Alocal, v, v, ctx->localrows, ctx->numcols, 0);
+    }
+}
+
+void segmentGramianVecProd(struct PcaContext * ctx, double xseg[], double yseg[], int segcounts[], int segoffsets[], double X[]) {
+    double gramstart = MPI_Wtime(), shift;
+    MPI_Allgatherv(xseg, segcounts[ctx->mpi_rank], MPI_DOUBLE, X, segcounts, segoffsets, MPI_DOUBLE, ctx->comm);
+    double computestart = MPI_Wtime();
+    if (centered(ctx)) {
+        centeringInput(ctx, X, 1, X, &shift);
+    }
+    localGramianVecProd(ctx, X);
+    if (centered(ctx)) {
+        // the rank one correction is additive, so only rank 0 applies it to its partial sum; the column scaling is linear and applies to all of them
+        shift = ctx->mpi_rank == 0 ? shift : 0;
+        centerGramianOutput(ctx, X, 1, &shift);
+    }
+    double commstart = MPI_Wtime();
+    MPI_Reduce_scatter(X, yseg, segcounts, MPI_DOUBLE, MPI_SUM, ctx->comm);
+    double gramstop = MPI_Wtime();
+    ctx->tgramexposedcomm += (computestart - gramstart) + (gramstop - commstart);
+    ctx->tgramtotal += gramstop - gramstart;
+    ctx->ngramcalls = ctx->ngramcalls + 1;
+    phaseAdd(ctx, PHASE_GRAM_COMPUTE, commstart - computestart);
+    phaseAdd(ctx, PHASE_GRAM_ALLREDUCE, (computestart - gramstart) + (gramstop - commstart));
+    countMatrixPass(ctx, 4, 1, 1);
+}
+
+double gridGramianVecProd(struct PcaContext * ctx, double v[]) {
+    double commtime = 0., commstart;
+
+    commstart = MPI_Wtime();
+    if (ctx->gridrow == 0) {
+        MPI_Scatterv(v, ctx->gridcolcounts, ctx->gridcoloffsets, MPI_DOUBLE, ctx->GridX, ctx->localcols, MPI_DOUBLE, 0, ctx->rowcomm);
+    }
+    MPI_Bcast(ctx->GridX, ctx->localcols, MPI_DOUBLE, 0, ctx->colcomm);
+    commtime += MPI_Wtime() - commstart;
+
+    multiplyAVec(ctx->Alocal, ctx->GridX, ctx->GridT, ctx->localrows, ctx->localcols);
+    commstart = MPI_Wtime();
+    MPI_Allreduce(MPI_IN_PLACE, ctx->GridT, ctx->localrows, MPI_DOUBLE, MPI_SUM, ctx->rowcomm);
+    commtime += MPI_Wtime() - commstart;
+
+    multiplyATransVecCols(ctx, ctx->Alocal, ctx->GridT, ctx->GridX, ctx->localrows, ctx->localcols, 0, ctx->localcols);
+    commstart = MPI_Wtime();
+    MPI_Reduce(ctx->gridrow == 0 ? MPI_IN_PLACE : ctx->GridX, ctx->GridX, ctx->localcols, MPI_DOUBLE, MPI_SUM, 0, ctx->colcomm);
+    if (ctx->gridrow == 0) {
+        MPI_Gatherv(ctx->GridX, ctx->localcols, MPI_DOUBLE, v, ctx->gridcolcounts, ctx->gridcoloffsets, MPI_DOUBLE, 0, ctx->rowcomm);
+    }
+    commtime += MPI_Wtime() - commstart;
+    return commtime;
+}
+
+void chunkedAllreduce(double buf[], long count, MPI_Comm comm) {
+    long first;
+    for(first = 0; first < count; first = first + MAX_COLLECTIVE_COUNT) {
+        int piece = count - first < MAX_COLLECTIVE_COUNT ? count - first : MAX_COLLECTIVE_COUNT;
+        MPI_Allreduce(MPI_IN_PLACE, buf + first, piece, MPI_DOUBLE, MPI_SUM, comm);
+    }
+}
+
+void chunkedBcast(double buf[], long count, int root, MPI_Comm comm) {
+    long first;
+    for(first = 0; first < count; first = first + MAX_COLLECTIVE_COUNT) {
+        int piece = count - first < MAX_COLLECTIVE_COUNT ? count - first : MAX_COLLECTIVE_COUNT;
+        MPI_Bcast(buf + first, piece, MPI_DOUBLE, root, comm);
+    }
+}
+
+void shareArpackRequest(struct PcaContext * ctx, double vector[], int * ido) {
+    if (ctx->opts.gridcols > 0) {
+        MPI_Bcast(ido, 1, MPI_INT, 0, ctx->comm);
+    } else {
+        vector[ctx->numcols] = *ido;
+        MPI_Bcast(vector, ctx->numcols + 1, MPI_DOUBLE, 0, ctx->comm);
+        *ido = (int) vector[ctx->numcols];
+    }
+}
+
+void blockPartition(int total, int parts, int part, int * size, int * start) {
+    int littlePartitionSize = total/parts;
+    int bigPartitionSize = littlePartitionSize + 1;
+    int numBigPartitions = total % parts;
+
+    if (part < numBigPartitions) {
+        *size = bigPartitionSize;
+        *start = bigPartitionSize*part;
+    } else {
+        *size = littlePartitionSize;
+        *start = bigPartitionSize*numBigPartitions + littlePartitionSize*(part - numBigPartitions);
+    }
+}
+
+void alignedPartition(struct PcaContext * ctx, long total, int parts, int part, int align, int * size, long * start) {
+    long numgroups = align > 0 ? (total + align - 1)/align : 0;
+    long groupitems = numgroups < parts ? 1 : align;
+    long numunits = numgroups < parts ? total : numgroups;
+    long littlePartitionSize = numunits/parts;
+    long numBigPartitions = numunits % parts;
+    long firstunit = littlePartitionSize*part + (part < numBigPartitions ? part : numBigPartitions);
+    long numpartunits = littlePartitionSize + (part < numBigPartitions ? 1 : 0);
+    long end = (firstunit + numpartunits)*groupitems;
+    long partsize = (end < total ? end : total) - firstunit*groupitems;
+    if (partsize > INT_MAX) {
+        printf("Process %d would get %ld rows, more than the %d a BLAS call can take; use more ranks\n", ctx->mpi_rank, partsize, INT_MAX);
+        MPI_Abort(ctx->comm, -1);
+    }
+    *start = firstunit*groupitems;
+    *size = partsize;
+}
+
+int datasetChunkRows(char * infilename, char * datasetname) {
+    int chunkrows = 0;
+    hid_t file_id = H5Fopen(infilename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dataset_id = H5Dopen(file_id, datasetname, H5P_DEFAULT);
+    hid_t dcpl_id = H5Dget_create_plist(dataset_id);
+    if (H5Pget_layout(dcpl_id) == H5D_CHUNKED) {
+        hsize_t chunkdims[2];
+        H5Pget_chunk(dcpl_id, 2, chunkdims);
+        chunkrows = chunkdims[0];
+    }
+    H5Pclose(dcpl_id);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    return chunkrows;
+}
+
+MPI_Info readHints(struct PcaContext * ctx, int mode) {
+    MPI_Info readinfo;
+    char value[32];
+    MPI_Info_create(&readinfo);
+    if (mode == READ_COLLECTIVE) {
+        MPI_Info_set(readinfo, "romio_cb_read", "enable");
+    }
+    if (ctx->opts.cbnodes > 0) {
+        sprintf(value, "%d", ctx->opts.cbnodes);
+        MPI_Info_set(readinfo, "cb_nodes", value);
+    }
+    if (ctx->opts.cbbuffermb > 0) {
+        sprintf(value, "%ld", (long) ctx->opts.cbbuffermb*1024*1024);
+        MPI_Info_set(readinfo, "cb_buffer_size", value);
+    }
+    return readinfo;
+}
+
+void readLocalBlock(struct PcaContext * ctx, char * infilename, char * datasetname, int mode, void * buffer) {
+    if (mode == READ_NODELEADER) {
+        readLocalBlockNodeLeader(ctx, infilename, datasetname, buffer);
+        return;
+    }
+    hsize_t offset[2], count[2], memdims[2];
+    size_t elementsize = ctx->opts.singleprecision ? sizeof(float) : sizeof(double);
+    MPI_Info readinfo = readHints(ctx, mode);
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, readinfo);
+    hid_t file_id = H5Fopen(infilename, H5F_ACC_RDONLY, plist_id);
+    hid_t dataset_id = H5Dopen(file_id, datasetname, H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset_id);
+    hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl_id, mode == READ_COLLECTIVE ? H5FD_MPIO_COLLECTIVE : H5FD_MPIO_INDEPENDENT);
+
+    // the block is read in pieces of at most READ_PIECE_MB; in a collective read every rank makes as many calls as the
+    // rank with the most pieces, and a rank without rows left takes part selecting nothing
+    long piecerows = (long) READ_PIECE_MB*1024*1024/(ctx->localcols*elementsize);
+    piecerows = piecerows < 1 ? 1 : piecerows;
+    int numpieces = (ctx->localrows + piecerows - 1)/piecerows, piece;
+    if (mode == READ_COLLECTIVE) {
+        MPI_Allreduce(MPI_IN_PLACE, &numpieces, 1, MPI_INT, MPI_MAX, ctx->comm);
+    }
+    for(piece = 0; piece < numpieces; piece = piece + 1) {
+        long firstrow = piece*piecerows;
+        long rows = ctx->localrows - firstrow < piecerows ? ctx->localrows - firstrow : piecerows;
+        rows = rows > 0 ? rows : 0;
+        offset[0] = ctx->startingrow + firstrow;
+        offset[1] = ctx->startingcol;
+        count[0] = rows;
+        count[1] = ctx->localcols;
+        memdims[0] = rows > 0 ? rows : 1;
+        memdims[1] = ctx->localcols;
+        hid_t memspace = H5Screate_simple(2, memdims, NULL);
+        if (rows > 0) {
+            H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        } else {
+            H5Sselect_none(filespace);
+            H5Sselect_none(memspace);
+        }
+        // HDF5 does the conversion when the file holds doubles and we store singles
+        herr_t status = H5Dread(dataset_id, ctx->opts.singleprecision ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE, memspace, filespace, dxpl_id,
+                                (char *) buffer + (rows > 0 ? (size_t) firstrow*ctx->localcols*elementsize : 0));
+        H5Sclose(memspace);
+        if (status < 0) {
+            printf("Failed to read %s on process %d\n", datasetname, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+
+    H5Pclose(dxpl_id);
+    H5Sclose(filespace);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+    MPI_Info_free(&readinfo);
+}
+
+/* only the first rank on each node opens the file; it reads every rank's block on its node in pieces of about READ_CHUNK_MB
+   and sends them on, alternating between two staging buffers so the next read overlaps the previous send */
+void readLocalBlockNodeLeader(struct PcaContext * ctx, char * infilename, char * datasetname, void * buffer) {
+    MPI_Comm nodecomm, leadercomm;
+    int noderank, nodesize, member;
+    long block[4], * blocks = NULL; // starting row, rows, starting column and columns of each rank's block
+    size_t elementsize = ctx->opts.singleprecision ? sizeof(float) : sizeof(double);
+    MPI_Comm_split_type(ctx->comm, MPI_COMM_TYPE_SHARED, ctx->mpi_rank, MPI_INFO_NULL, &nodecomm);
+    MPI_Comm_rank(nodecomm, &noderank);
+    MPI_Comm_size(nodecomm, &nodesize);
+    MPI_Comm_split(ctx->comm, noderank == 0 ? 0 : MPI_UNDEFINED, ctx->mpi_rank, &leadercomm);
+
+    block[0] = ctx->startingrow;
+    block[1] = ctx->localrows;
+    block[2] = ctx->startingcol;
+    block[3] = ctx->localcols;
+    if (noderank == 0) {
+        blocks = (long *) malloc( 4 * nodesize * sizeof(long));
+        if (blocks == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+    }
+    MPI_Gather(block, 4, MPI_LONG, blocks, 4, MPI_LONG, 0, nodecomm);
+
+    if (noderank != 0) {
+        int chunkrows = READ_CHUNK_MB*1024*1024/(ctx->localcols*elementsize), firstrow;
+        chunkrows = chunkrows < 1 ? 1 : chunkrows;
+        for(firstrow = 0; firstrow < ctx->localrows; firstrow = firstrow + chunkrows) {
+            int piecerows = ctx->localrows - firstrow < chunkrows ? ctx->localrows - firstrow : chunkrows;
+            MPI_Recv((char *) buffer + (size_t) firstrow*ctx->localcols*elementsize, (size_t) piecerows*ctx->localcols*elementsize, MPI_BYTE, 0, 0, nodecomm, MPI_STATUS_IGNORE);
+        }
+        MPI_Comm_free(&nodecomm);
+        return;
+    }
+
+    MPI_Info readinfo = readHints(ctx, READ_INDEPENDENT);
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, leadercomm, readinfo);
+    hid_t file_id = H5Fopen(infilename, H5F_ACC_RDONLY, plist_id);
+    hid_t dataset_id = H5Dopen(file_id, datasetname, H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset_id);
+    hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_INDEPENDENT);
+    hid_t memtype = ctx->opts.singleprecision ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE;
+
+    void * staging[2];
+    MPI_Request sends[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    int current = 0;
+    long maxcols = 0;
+    for(member = 0; member < nodesize; member = member + 1) {
+        maxcols = blocks[4*member + 3] > maxcols ? blocks[4*member + 3] : maxcols;
+    }
+    staging[0] = malloc( READ_CHUNK_MB*1024*1024 + maxcols*elementsize);
+    staging[1] = malloc( READ_CHUNK_MB*1024*1024 + maxcols*elementsize);
+    if (staging[0] == NULL || staging[1] == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+
+    for(member = 0; member < nodesize; member = member + 1) {
+        long memberrows = blocks[4*member + 1], membercols = blocks[4*member + 3], firstrow;
+        int chunkrows = READ_CHUNK_MB*1024*1024/(membercols*elementsize);
+        chunkrows = chunkrows < 1 ? 1 : chunkrows;
+        for(firstrow = 0; firstrow < memberrows; firstrow = firstrow + chunkrows) {
+            hsize_t offset[2], count[2];
+            offset[0] = blocks[4*member] + firstrow;
+            offset[1] = blocks[4*member + 2];
+            count[0] = memberrows - firstrow < chunkrows ? memberrows - firstrow : chunkrows;
+            count[1] = membercols;
+            void * target = buffer;
+            if (member == 0) {
+                target = (char *) buffer + (size_t) firstrow*membercols*elementsize;
+            } else {
+                MPI_Wait(sends + current, MPI_STATUS_IGNORE);
+                target = staging[current];
+            }
+            hid_t memspace = H5Screate_simple(2, count, NULL);
+            H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+            if (H5Dread(dataset_id, memtype, memspace, filespace, dxpl_id, target) < 0) {
+                printf("Failed to read %s on process %d\n", datasetname, ctx->mpi_rank);
+                MPI_Abort(ctx->comm, -1);
+            }
+            H5Sclose(memspace);
+            if (member != 0) {
+                MPI_Isend(target, count[0]*count[1]*elementsize, MPI_BYTE, member, 0, nodecomm, sends + current);
+                current = 1 - current;
+            }
+        }
+    }
+    MPI_Waitall(2, sends, MPI_STATUSES_IGNORE);
+
+    free(staging[0]);
+    free(staging[1]);
+    free(blocks);
+    H5Pclose(dxpl_id);
+    H5Sclose(filespace);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+    MPI_Info_free(&readinfo);
+    MPI_Comm_free(&leadercomm);
+    MPI_Comm_free(&nodecomm);
+}
+
+void readBenchmark(struct PcaContext * ctx, char * infilename, char * datasetname, int reps) {
+    size_t elementsize = ctx->opts.singleprecision ? sizeof(float) : sizeof(double);
+    void * buffer = malloc( (size_t) (ctx->localrows > 0 ? ctx->localrows : 1) * ctx->localcols * elementsize);
+    if (buffer == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    double gigabytes = (double) ctx->numrows*ctx->numcols*elementsize/1e9;
+    if (ctx->mpi_rank == 0) {
+        printf("Read benchmark: %ld x %d %s matrix (%.3f GB), best of %d reads per mode\n", ctx->numrows, ctx->numcols,
+               ctx->opts.singleprecision ? "single precision" : "double precision", gigabytes, reps);
+    }
+    int mode, rep;
+    for(mode = 0; mode < NUM_READ_MODES; mode = mode + 1) {
+        double best = 0;
+        for(rep = 0; rep < reps; rep = rep + 1) {
+            MPI_Barrier(ctx->comm);
+            double start = MPI_Wtime();
+            readLocalBlock(ctx, infilename, datasetname, mode, buffer);
+            double elapsed = MPI_Wtime() - start;
+            // a read is only done when the slowest rank has its rows
+            MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, ctx->comm);
+            best = rep == 0 || elapsed < best ? elapsed : best;
+        }
+        if (ctx->mpi_rank == 0) {
+            printf("  %-12s %10.3f s %10.3f GB/s\n", readModeNames[mode], best, best > 0 ? gigabytes/best : 0.0);
+        }
+    }
+    free(buffer);
+}
+
+void sparsePartition(struct PcaContext * ctx, char * infilename, char * groupname) {
+    long * rowbounds = (long *) malloc( (ctx->mpi_size + 1) * sizeof(long));
+    if (rowbounds == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (ctx->mpi_rank == 0) {
+        char name[1024];
+        hsize_t dims[1], offset[1], count[1];
+        hid_t file_id = H5Fopen(infilename, H5F_ACC_RDONLY, H5P_DEFAULT);
+        snprintf(name, sizeof(name), "%s/indptr", groupname);
+        hid_t dataset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+        if (dataset_id < 0) {
+            printf("Could not open %s in %s\n", name, infilename);
+            MPI_Abort(ctx->comm, -1);
+        }
+        hid_t filespace = H5Dget_space(dataset_id);
+        H5Sget_simple_extent_dims(filespace, dims, NULL);
+        if (dims[0] < (hsize_t) ctx->numrows + 1) {
+            printf("%s has %ld entries, too few for %ld rows\n", name, (long) dims[0], ctx->numrows);
+            MPI_Abort(ctx->comm, -1);
+        }
+        long * indptr = (long *) malloc( (ctx->numrows + 1) * sizeof(long));
+        if (indptr == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+        offset[0] = 0;
+        count[0] = ctx->numrows + 1;
+        hid_t memspace = H5Screate_simple(1, count, NULL);
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        H5Dread(dataset_id, H5T_NATIVE_LONG, memspace, filespace, H5P_DEFAULT, indptr);
+        H5Sclose(memspace);
+        H5Sclose(filespace);
+        H5Dclose(dataset_id);
+        H5Fclose(file_id);
+
+        // part p starts at the first row with at least p/mpi_size of the entries before it
+        long totalnnz = indptr[ctx->numrows] - indptr[0];
+        int part;
+        long row = 0;
+        rowbounds[0] = 0;
+        for(part = 1; part < ctx->mpi_size; part = part + 1) {
+            long target = indptr[0] + (long) ((double) totalnnz*part/ctx->mpi_size);
+            while(row < ctx->numrows && indptr[row] < target) {
+                row = row + 1;
+            }
+            rowbounds[part] = row;
+        }
+        rowbounds[ctx->mpi_size] = ctx->numrows;
+        free(indptr);
+    }
+    MPI_Bcast(rowbounds, ctx->mpi_size + 1, MPI_LONG, 0, ctx->comm);
+    if (rowbounds[ctx->mpi_rank + 1] - rowbounds[ctx->mpi_rank] > INT_MAX) {
+        printf("Process %d would get %ld rows, more than the %d a BLAS call can take; use more ranks\n", ctx->mpi_rank, rowbounds[ctx->mpi_rank + 1] - rowbounds[ctx->mpi_rank], INT_MAX);
+        MPI_Abort(ctx->comm, -1);
+    }
+    ctx->startingrow = rowbounds[ctx->mpi_rank];
+    ctx->localrows = rowbounds[ctx->mpi_rank + 1] - rowbounds[ctx->mpi_rank];
+    free(rowbounds);
+}
+
+void readLocalCsr(struct PcaContext * ctx, char * infilename, char * groupname, int mode) {
+    char name[1024];
+    hsize_t offset[1], count[1];
+    MPI_Info readinfo = readHints(ctx, mode);
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, readinfo);
+    hid_t file_id = H5Fopen(infilename, H5F_ACC_RDONLY, plist_id);
+    hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl_id, mode == READ_COLLECTIVE ? H5FD_MPIO_COLLECTIVE : H5FD_MPIO_INDEPENDENT);
+
+    // this rank's rows of indptr, one past the last so the row lengths are known
+    ctx->CsrRowPtr = (long *) malloc( (ctx->localrows + 1) * sizeof(long));
+    if (ctx->CsrRowPtr == NULL) {
+        printf("Out of memory in process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    snprintf(name, sizeof(name), "%s/indptr", groupname);
+    hid_t dataset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset_id);
+    offset[0] = ctx->startingrow;
+    count[0] = ctx->localrows + 1;
+    hid_t memspace = H5Screate_simple(1, count, NULL);
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+    herr_t status = H5Dread(dataset_id, H5T_NATIVE_LONG, memspace, filespace, dxpl_id, ctx->CsrRowPtr);
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    H5Dclose(dataset_id);
+    if (status < 0) {
+        printf("Failed to read %s on process %d\n", name, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    long firstentry = ctx->CsrRowPtr[0];
+    int rowidx;
+    for(rowidx = 0; rowidx <= ctx->localrows; rowidx = rowidx + 1) {
+        ctx->CsrRowPtr[rowidx] -= firstentry;
+    }
+    ctx->localnnz = ctx->CsrRowPtr[ctx->localrows];
+
+    ctx->CsrColIdx = (int *) malloc( (ctx->localnnz > 0 ? ctx->localnnz : 1) * sizeof(int));
+    ctx->CsrValues = (double *) malloc( (ctx->localnnz > 0 ? ctx->localnnz : 1) * sizeof(double));
+    if (ctx->CsrColIdx == NULL || ctx->CsrValues == NULL) {
+        printf("Out of memory in process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    // the sparse kernels balance rows dynamically, so the entries are just spread evenly over the threads' domains
+    firstTouchRows(ctx->CsrColIdx, ctx->localnnz, sizeof(int), 4096);
+    firstTouchRows(ctx->CsrValues, ctx->localnnz, sizeof(double), 4096);
+    const char * fields[2] = {"indices", "data"};
+    void * buffers[2] = {ctx->CsrColIdx, ctx->CsrValues};
+    hid_t types[2] = {H5T_NATIVE_INT, H5T_NATIVE_DOUBLE};
+    int field;
+    for(field = 0; field < 2; field = field + 1) {
+        snprintf(name, sizeof(name), "%s/%s", groupname, fields[field]);
+        dataset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+        filespace = H5Dget_space(dataset_id);
+        offset[0] = firstentry;
+        count[0] = ctx->localnnz > 0 ? ctx->localnnz : 1;
+        memspace = H5Screate_simple(1, count, NULL);
+        // a rank without entries still takes part in a collective read, selecting nothing
+        if (ctx->localnnz > 0) {
+            H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        } else {
+            H5Sselect_none(filespace);
+            H5Sselect_none(memspace);
+        }
+        status = H5Dread(dataset_id, types[field], memspace, filespace, dxpl_id, buffers[field]);
+        H5Sclose(memspace);
+        H5Sclose(filespace);
+        H5Dclose(dataset_id);
+        if (status < 0) {
+            printf("Failed to read %s on process %d\n", name, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+    H5Pclose(dxpl_id);
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+    MPI_Info_free(&readinfo);
+
+    long entryidx;
+    for(entryidx = 0; entryidx < ctx->localnnz; entryidx = entryidx + 1) {
+        if (ctx->CsrColIdx[entryidx] < 0 || ctx->CsrColIdx[entryidx] >= ctx->numcols) {
+            printf("Column index %d out of range in %s/indices on process %d\n", ctx->CsrColIdx[entryidx], groupname, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+}
+
+void checksumPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg) {
+    double * sum = (double *) arg;
+    int rowidx, colidx;
+    for(rowidx = 0; rowidx < panelrows; rowidx = rowidx + 1) {
+        long globalrow = ctx->startingrow + firstrow + rowidx;
+        for(colidx = 0; colidx < ctx->localcols; colidx = colidx + 1) {
+            *sum += panel[(long) rowidx*ctx->localcols + colidx]*(1 + ((globalrow*7 + (ctx->startingcol + colidx)*13) % 101)/101.0);
+        }
+    }
+}
+
+void checkpointFingerprint(struct PcaContext * ctx, double fingerprint[]) {
+    if (!ctx->datachecksumready) {
+        ctx->datachecksum = 0;
+        if (ctx->opts.sparse) {
+            ctx->datachecksum = checksumCsr(ctx);
+        } else {
+            forEachRowPanel(ctx, checksumPanel, NULL, &ctx->datachecksum);
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &ctx->datachecksum, 1, MPI_DOUBLE, MPI_SUM, ctx->comm);
+        ctx->datachecksumready = 1;
+    }
+    fingerprint[0] = ctx->numrows;
+    fingerprint[1] = ctx->numcols;
+    fingerprint[2] = ctx->numeigs;
+    fingerprint[3] = ctx->arpackncv;
+    fingerprint[4] = ctx->opts.solver;
+    fingerprint[5] = centered(ctx) + 2*ctx->opts.scale;
+    fingerprint[6] = ctx->opts.singleprecision;
+    fingerprint[7] = ctx->datachecksum;
+    fingerprint[8] = 0; // filled in by the caller with the input name hash
+}
+
+void writeCheckpoint(struct PcaContext * ctx, double state[], int numvecs, double Vsegs[], int segrows, int segstart, double T[], int ncv) {
+    double fingerprint[CHECKPOINT_FINGERPRINT_LEN], partition[CHECKPOINT_PARTITION_LEN];
+    hsize_t dims[2], offset[2], count[2];
+    char tmpfname[1024];
+    double tcheckpointstr = MPI_Wtime();
+
+    checkpointFingerprint(ctx, fingerprint);
+    fingerprint[8] = checkpointNameHash(ctx, ctx->infilename);
+    checkpointLayout(ctx, partition);
+
+    snprintf(tmpfname, sizeof(tmpfname), "%s.tmp", ctx->opts.checkpointfname);
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, MPI_INFO_NULL);
+    hid_t file_id = H5Fcreate(tmpfname, H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
+    if (file_id < 0) {
+        printf("Could not create checkpoint %s on process %d\n", tmpfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+
+    // the small replicated datasets come from rank 0
+    offset[0] = 0;
+    offset[1] = 0;
+    dims[0] = CHECKPOINT_FINGERPRINT_LEN;
+    count[0] = ctx->mpi_rank == 0 ? dims[0] : 0;
+    writeDatasetCollective(ctx, file_id, "/fingerprint", 1, dims, 0, offset, count, fingerprint);
+    dims[0] = CHECKPOINT_PARTITION_LEN;
+    count[0] = ctx->mpi_rank == 0 ? dims[0] : 0;
+    writeDatasetCollective(ctx, file_id, "/partition", 1, dims, 0, offset, count, partition);
+    dims[0] = CHECKPOINT_STATE_LEN;
+    count[0] = ctx->mpi_rank == 0 ? dims[0] : 0;
+    writeDatasetCollective(ctx, file_id, "/state", 1, dims, 0, offset, count, state);
+    if (T != NULL) {
+        dims[0] = ncv;
+        dims[1] = ncv;
+        count[0] = ctx->mpi_rank == 0 ? ncv : 0;
+        count[1] = ncv;
+        writeDatasetCollective(ctx, file_id, "/T", 2, dims, 0, offset, count, T);
+    }
+
+    // the saved vectors are stored whole, so a job can resume on a different number of ranks
+    dims[0] = numvecs;
+    dims[1] = ctx->numcols;
+    offset[1] = segstart;
+    count[0] = segrows > 0 ? numvecs : 0;
+    count[1] = segrows;
+    writeDatasetCollective(ctx, file_id, "/V", 2, dims, 0, offset, count, Vsegs);
+
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+    MPI_Barrier(ctx->comm);
+    if (ctx->mpi_rank == 0) {
+        if (rename(tmpfname, ctx->opts.checkpointfname) != 0) {
+            printf("Could not move the checkpoint to %s\n", ctx->opts.checkpointfname);
+        }
+        printf("Checkpointed the eigensolver after %d matrix-vector products in %f s\n", (int) state[0], MPI_Wtime() - tcheckpointstr);
+    }
+    MPI_Barrier(ctx->comm);
+    ctx->lastcheckpoint = ctx->ngramcalls;
+}
+
+int readCheckpoint(struct PcaContext * ctx, double state[], int numvecs, double Vsegs[], int segrows, int segstart, double T[]) {
+    double fingerprint[CHECKPOINT_FINGERPRINT_LEN], saved[CHECKPOINT_FINGERPRINT_LEN], partition[CHECKPOINT_PARTITION_LEN], layout[CHECKPOINT_PARTITION_LEN];
+    int exists = 0, idx;
+    if (!ctx->opts.resume) {
+        return 0;
+    }
+    if (ctx->mpi_rank == 0) {
+        FILE * probe = fopen(ctx->opts.checkpointfname, "r");
+        exists = probe != NULL;
+        if (probe != NULL) {
+            fclose(probe);
+        } else {
+            printf("No checkpoint at %s, starting the eigensolver from scratch\n", ctx->opts.checkpointfname);
+        }
+    }
+    MPI_Bcast(&exists, 1, MPI_INT, 0, ctx->comm);
+    if (!exists) {
+        return 0;
+    }
+
+    checkpointFingerprint(ctx, fingerprint);
+    fingerprint[8] = checkpointNameHash(ctx, ctx->infilename);
+    checkpointLayout(ctx, layout);
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, MPI_INFO_NULL);
+    hid_t file_id = H5Fopen(ctx->opts.checkpointfname, H5F_ACC_RDONLY, plist_id);
+    if (file_id < 0) {
+        printf("Could not open checkpoint %s on process %d\n", ctx->opts.checkpointfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    hsize_t dims[2], offset[2], count[2];
+    dims[0] = CHECKPOINT_FINGERPRINT_LEN;
+    readCheckpointDataset(ctx, file_id, "/fingerprint", 1, dims, saved);
+    for(idx = 0; idx < CHECKPOINT_FINGERPRINT_LEN; idx = idx + 1) {
+        // the checksum is summed in a different order on a different partitioning
+        double tolerance = idx == 7 ? 1e-10*fabs(fingerprint[idx]) : 0;
+        if (fabs(saved[idx] - fingerprint[idx]) > tolerance) {
+            if (ctx->mpi_rank == 0) {
+                printf("Checkpoint %s was written for a different problem (fingerprint entry %d is %g, expected %g); not resuming from it\n",
+                       ctx->opts.checkpointfname, idx, saved[idx], fingerprint[idx]);
+            }
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+    dims[0] = CHECKPOINT_PARTITION_LEN;
+    readCheckpointDataset(ctx, file_id, "/partition", 1, dims, partition);
+    // a different layout is fine, since every rank reads its own segments of the whole vectors below
+    if (ctx->mpi_rank == 0 && memcmp(partition, layout, sizeof(layout)) != 0) {
+        printf("Checkpoint was written on %d ranks", (int) partition[0]);
+        if (partition[1] > 0) {
+            printf(" (grid %dx%d)", (int) partition[1], (int) partition[2]);
+        }
+        printf(" with a different row partition; its vectors are stored whole, so resuming on this layout\n");
+    }
+    dims[0] = CHECKPOINT_STATE_LEN;
+    readCheckpointDataset(ctx, file_id, "/state", 1, dims, state);
+    if (T != NULL) {
+        // arpackncv is part of the fingerprint checked above
+        dims[0] = ctx->arpackncv;
+        dims[1] = ctx->arpackncv;
+        readCheckpointDataset(ctx, file_id, "/T", 2, dims, T);
+    }
+
+    // each rank reads its own segment of every saved vector
+    hid_t dataset_id = H5Dopen(file_id, "/V", H5P_DEFAULT);
+    if (dataset_id < 0) {
+        printf("Checkpoint %s has no /V on process %d\n", ctx->opts.checkpointfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    hid_t filespace = H5Dget_space(dataset_id);
+    if (H5Sget_simple_extent_ndims(filespace) != 2) {
+        printf("Checkpoint %s has a /V that is not 2D on process %d\n", ctx->opts.checkpointfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    H5Sget_simple_extent_dims(filespace, dims, NULL);
+    if (dims[0] > (hsize_t) numvecs || dims[1] != (hsize_t) ctx->numcols) {
+        printf("Checkpoint %s holds %d vectors of length %d, expected at most %d of length %d\n", ctx->opts.checkpointfname, (int) dims[0], (int) dims[1], numvecs, ctx->numcols);
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (segrows > 0) {
+        offset[0] = 0;
+        offset[1] = segstart;
+        count[0] = dims[0];
+        count[1] = segrows;
+        hid_t memspace = H5Screate_simple(2, count, NULL);
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+        H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_INDEPENDENT);
+        if (H5Dread(dataset_id, H5T_NATIVE_DOUBLE, memspace, filespace, dxpl_id, Vsegs) < 0) {
+            printf("Failed to read /V of checkpoint %s on process %d\n", ctx->opts.checkpointfname, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+        H5Pclose(dxpl_id);
+        H5Sclose(memspace);
+    }
+    H5Sclose(filespace);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+    if (ctx->mpi_rank == 0) {
+        printf("Resuming the eigensolver from %s, written after %d matrix-vector products\n", ctx->opts.checkpointfname, (int) state[0]);
+    }
+    ctx->lastcheckpoint = 0;
+    return 1;
+}
+
+void checkpointLayout(struct PcaContext * ctx, double layout[]) {
+    layout[0] = ctx->mpi_size;
+    layout[1] = ctx->opts.gridrows;
+    layout[2] = ctx->opts.gridcols;
+    layout[3] = (double) ctx->startingrow*(ctx->mpi_rank + 1);
+    MPI_Allreduce(MPI_IN_PLACE, layout + 3, 1, MPI_DOUBLE, MPI_SUM, ctx->comm);
+}
+
+void readCheckpointDataset(struct PcaContext * ctx, hid_t file_id, const char * name, int ndims, hsize_t dims[], double buf[]) {
+    hsize_t saveddims[2];
+    int idx, matches = 0;
+    hid_t dataset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+    if (dataset_id >= 0) {
+        hid_t filespace = H5Dget_space(dataset_id);
+        if (H5Sget_simple_extent_ndims(filespace) == ndims) {
+            H5Sget_simple_extent_dims(filespace, saveddims, NULL);
+            matches = 1;
+            for(idx = 0; idx < ndims; idx = idx + 1) {
+                matches = matches && saveddims[idx] == dims[idx];
+            }
+        }
+        H5Sclose(filespace);
+    }
+    if (!matches) {
+        printf("Checkpoint %s has no %s of the expected size on process %d\n", ctx->opts.checkpointfname, name, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (H5Dread(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf) < 0) {
+        printf("Failed to read %s of checkpoint %s on process %d\n", name, ctx->opts.checkpointfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    H5Dclose(dataset_id);
+}
+
+double checkpointNameHash(struct PcaContext * ctx, char * name) {
+    unsigned long hash = 5381;
+    char * c;
+    for(c = name; *c != '\0'; c = c + 1) {
+        hash = hash*33 + (unsigned char) *c;
+    }
+    for(c = ctx->datasetname; *c != '\0'; c = c + 1) {
+        hash = hash*33 + (unsigned char) *c;
+    }
+    return (double) (hash % 4294967291UL);
+}
+
+double timeBlockingAllreduce(struct PcaContext * ctx, int count) {
+    int numreps = 3, repidx;
+    double * buffer = (double *) calloc(count, sizeof(double));
+    if (buffer == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    MPI_Barrier(ctx->comm);
+    double start = MPI_Wtime();
+    for(repidx = 0; repidx < numreps; repidx = repidx + 1) {
+        MPI_Allreduce(MPI_IN_PLACE, buffer, count, MPI_DOUBLE, MPI_SUM, ctx->comm);
+    }
+    double elapsed = (MPI_Wtime() - start)/numreps;
+    free(buffer);
+    // every rank reports the slowest rank's time, so all ranks agree on the reference
+    MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, ctx->comm);
+    return elapsed;
+}
+
+// computes A^T*A*mat and stores in matProd; every rank gets the full product
+void distributedGramianMatProd(struct PcaContext * ctx, double mat[], double matProd[], double Scratch[], int numvecs) {
+    struct GramianMatPanelArgs args;
+    double * shifts = NULL, * scaled = mat;
+    if (centered(ctx)) {
+        shifts = (double *) malloc( numvecs * sizeof(double));
+        scaled = ctx->opts.scale ? (double *) malloc( (size_t) ctx->numcols * numvecs * sizeof(double)) : mat;
+        if (shifts == NULL || scaled == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+        centeringInput(ctx, mat, numvecs, scaled, shifts);
+    }
+    args.mat = scaled;
+    args.matProd = matProd;
+    args.Scratch = Scratch;
+    args.numvecs = numvecs;
+    args.accumulate = 0;
+    double gramstart = MPI_Wtime();
+    if (ctx->opts.sparse) {
+        multiplyGramianChunkCsr(ctx, scaled, matProd, numvecs);
+    } else {
+        forEachRowPanel(ctx, gramianMatPanel, NULL, &args);
+    }
+    double commstart = MPI_Wtime();
+    chunkedAllreduce(matProd, (long) ctx->numcols*numvecs, ctx->comm);
+    phaseAdd(ctx, PHASE_GRAM_COMPUTE, commstart - gramstart);
+    phaseAdd(ctx, PHASE_GRAM_ALLREDUCE, MPI_Wtime() - commstart);
+    countMatrixPass(ctx, 4, numvecs, 1);
+    if (centered(ctx)) {
+        centerGramianOutput(ctx, matProd, numvecs, shifts);
+        if (scaled != mat) {
+            free(scaled);
+        }
+        free(shifts);
+    }
+}
+
+// computes this rank's rows of A*mat, where mat is numcols-by-numvecs, into matProd; when centering, the rows of (A - 1*mu')*D*mat
+void localMatMatProd(struct PcaContext * ctx, double mat[], double matProd[], int numvecs) {
+    struct MatMatPanelArgs args;
+    double * shifts = NULL, * scaled = mat;
+    if (centered(ctx)) {
+        shifts = (double *) malloc( numvecs * sizeof(double));
+        scaled = ctx->opts.scale ? (double *) malloc( (size_t) ctx->numcols * numvecs * sizeof(double)) : mat;
+        if (shifts == NULL || scaled == NULL) {
+            printf("Out of memory on process %d\n", ctx->mpi_rank);
+            exit(-1);
+        }
+        centeringInput(ctx, mat, numvecs, scaled, shifts);
+    }
+    args.mat = scaled;
+    args.matProd = matProd;
+    args.numvecs = numvecs;
+    if (ctx->opts.sparse) {
+        multiplyAChunkCsr(ctx, scaled, matProd, numvecs);
+    } else {
+        forEachRowPanel(ctx, matMatPanel, NULL, &args);
+    }
+    countMatrixPass(ctx, 2, numvecs, 1);
+    if (ctx->opts.gridcols > 0) {
+        chunkedAllreduce(matProd, (long) ctx->localrows*numvecs, ctx->rowcomm);
+    }
+    if (centered(ctx)) {
+        int rowidx, vecidx;
+        for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+            for(vecidx = 0; vecidx < numvecs; vecidx = vecidx + 1) {
+                matProd[(long) rowidx*numvecs + vecidx] -= shifts[vecidx];
+            }
+        }
+        if (scaled != mat) {
+            free(scaled);
+        }
+        free(shifts);
+    }
+}
+
+void computeColumnMoments(struct PcaContext * ctx) {
+    struct ColumnMomentsPanelArgs args;
+    double * moments = (double *) calloc( 2 * ctx->numcols, sizeof(double));
+    ctx->colmeans = (double *) malloc( ctx->numcols * sizeof(double));
+    ctx->colstds = ctx->opts.scale ? (double *) malloc( ctx->numcols * sizeof(double)) : NULL;
+    ctx->colsumsquares = (double *) malloc( ctx->numcols * sizeof(double));
+    if (moments == NULL || ctx->colmeans == NULL || (ctx->opts.scale && ctx->colstds == NULL) || ctx->colsumsquares == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    args.sums = moments;
+    args.sumsquares = moments + ctx->numcols;
+    if (ctx->opts.sparse) {
+        columnMomentsCsr(ctx, args.sums, args.sumsquares);
+    } else {
+        forEachRowPanel(ctx, columnMomentsPanel, NULL, &args);
+    }
+    countMatrixPass(ctx, 3, 1, 1);
+    // the sums and the sums of squares travel together; on a grid each rank only fills in its own columns
+    MPI_Allreduce(MPI_IN_PLACE, moments, 2*ctx->numcols, MPI_DOUBLE, MPI_SUM, ctx->comm);
+
+    int colidx;
+    for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+        ctx->colmeans[colidx] = moments[colidx]/ctx->numrows;
+        if (ctx->opts.scale) {
+            double variance = ctx->numrows > 1 ? (moments[ctx->numcols + colidx] - ctx->numrows*ctx->colmeans[colidx]*ctx->colmeans[colidx])/(ctx->numrows - 1) : 0;
+            ctx->colstds[colidx] = variance > 0 ? sqrt(variance) : 1;
+        }
+    }
+    memcpy(ctx->colsumsquares, moments + ctx->numcols, ctx->numcols * sizeof(double));
+    free(moments);
+}
+
+// sum_j (sum_i A(i,j)^2 - numrows*mu_j^2)/sigma_j^2, with mu and sigma left out when not centering and scaling
+double totalVariance(struct PcaContext * ctx) {
+    double total = 0;
+    int colidx;
+    for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+        double sumsquares = ctx->colsumsquares[colidx] - (centered(ctx) ? ctx->numrows*ctx->colmeans[colidx]*ctx->colmeans[colidx] : 0);
+        total += ctx->opts.scale ? sumsquares/(ctx->colstds[colidx]*ctx->colstds[colidx]) : sumsquares;
+    }
+    return total > 0 ? total : 0;
+}
+
+void centeringInput(struct PcaContext * ctx, double mat[], int numvecs, double scaled[], double shifts[]) {
+    int colidx, vecidx;
+    memset(shifts, 0, numvecs * sizeof(double));
+    for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+        double invstd = ctx->opts.scale ? 1/ctx->colstds[colidx] : 1;
+        for(vecidx = 0; vecidx < numvecs; vecidx = vecidx + 1) {
+            scaled[(long) colidx*numvecs + vecidx] = invstd*mat[(long) colidx*numvecs + vecidx];
+            shifts[vecidx] += ctx->colmeans[colidx]*scaled[(long) colidx*numvecs + vecidx];
+        }
+    }
+}
+
+/* with B = (A - 1*mu')*D, B'*B*x = D*(A'*A*D*x - numrows*mu*(mu'*D*x)), since A'*1 = numrows*mu */
+void centerGramianOutput(struct PcaContext * ctx, double matProd[], int numvecs, double shifts[]) {
+    int colidx, vecidx;
+    for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+        double invstd = ctx->opts.scale ? 1/ctx->colstds[colidx] : 1;
+        for(vecidx = 0; vecidx < numvecs; vecidx = vecidx + 1) {
+            double * entry = matProd + (long) colidx*numvecs + vecidx;
+            *entry = invstd*(*entry - (double) ctx->numrows*ctx->colmeans[colidx]*shifts[vecidx]);
+        }
+    }
+}
+
+/* panel kernels for forEachRowPanel */
+
+void gramianVecPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg) {
+    struct GramianVecPanelArgs * args = (struct GramianVecPanelArgs *) arg;
+    (void) firstrow; // A'*A*x sums over the rows, so the panel's position does not matter
+    multiplyGramianVec(ctx, panel, args->x, args->y, panelrows, ctx->numcols, 1);
+}
+
+void gramianVecPanelSingle(struct PcaContext * ctx, float panel[], int panelrows, int firstrow, void * arg) {
+    struct GramianVecPanelArgs * args = (struct GramianVecPanelArgs *) arg;
+    (void) firstrow;
+    multiplyGramianVecSingle(ctx, panel, args->x, args->y, panelrows, ctx->numcols, 1);
+}
+
+void columnMomentsPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg) {
+    struct ColumnMomentsPanelArgs * args = (struct ColumnMomentsPanelArgs *) arg;
+    (void) firstrow;
+    double * sums = args->sums + ctx->startingcol, * sumsquares = args->sumsquares + ctx->startingcol;
+    int rowidx, colidx;
+    for(rowidx = 0; rowidx < panelrows; rowidx = rowidx + 1) {
+        const double * row = panel + (long) rowidx*ctx->localcols;
+        #pragma omp simd
+        for(colidx = 0; colidx < ctx->localcols; colidx = colidx + 1) {
+            sums[colidx] += row[colidx];
+            sumsquares[colidx] += row[colidx]*row[colidx];
+        }
+    }
+}
+
+// the first panel overwrites matProd, the rest accumulate into it
+void gramianMatPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg) {
+    struct GramianMatPanelArgs * args = (struct GramianMatPanelArgs *) arg;
+    (void) firstrow; // as in gramianVecPanel
+    multiplyGramianChunk(panel, args->mat, args->matProd, args->Scratch, panelrows, ctx->numcols, args->numvecs, args->accumulate);
+    args->accumulate = 1;
+}
+
+void matMatPanel(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg) {
+    struct MatMatPanelArgs * args = (struct MatMatPanelArgs *) arg;
+    multiplyAChunk(panel, args->mat + (long) ctx->startingcol*args->numvecs, args->matProd + (long) firstrow*args->numvecs, panelrows, ctx->localcols, args->numvecs);
+}
+
+struct PanelRead {
+    struct PcaContext * ctx;
+    void * buffer;
+    int firstrow; // relative to startingrow
+    int numrows;
+    herr_t status;
+};
+
+// reads one panel of this rank's rows from the open input dataset; also the body of the reader thread
+static void * readRowPanel(void * arg) {
+    struct PanelRead * panelread = (struct PanelRead *) arg;
+    struct PcaContext * ctx = panelread->ctx;
+    hsize_t offset[2], count[2];
+    offset[0] = ctx->startingrow + panelread->firstrow;
+    offset[1] = 0;
+    count[0] = panelread->numrows;
+    count[1] = ctx->numcols;
+    hid_t memspace = H5Screate_simple(2, count, NULL);
+    H5Sselect_hyperslab(ctx->streamfilespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+    panelread->status = H5Dread(ctx->streamdataset_id, ctx->opts.singleprecision ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE, memspace, ctx->streamfilespace, ctx->streamdxpl_id, panelread->buffer);
+    H5Sclose(memspace);
+    return NULL;
+}
+
+void applyPanelKernel(struct PcaContext * ctx, void * panel, int panelrows, int firstrow, void (*kernel)(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg),
+                      void (*singlekernel)(struct PcaContext * ctx, float panel[], int panelrows, int firstrow, void * arg), void * arg) {
+    if (!ctx->opts.singleprecision) {
+        kernel(ctx, (double *) panel, panelrows, firstrow, arg);
+    } else if (singlekernel != NULL) {
+        singlekernel(ctx, (float *) panel, panelrows, firstrow, arg);
+    } else {
+        int blockstart;
+        for(blockstart = 0; blockstart < panelrows; blockstart = blockstart + ctx->convertrows) {
+            int blockrows = panelrows - blockstart < ctx->convertrows ? panelrows - blockstart : ctx->convertrows;
+            const float * block = (float *) panel + (long) blockstart*ctx->numcols;
+            long entryidx;
+            #pragma omp parallel for schedule(static)
+            for(entryidx = 0; entryidx < (long) blockrows*ctx->numcols; entryidx = entryidx + 1) {
+                ctx->ConvertScratch[entryidx] = block[entryidx];
+            }
+            kernel(ctx, ctx->ConvertScratch, blockrows, firstrow + blockstart, arg);
+        }
+    }
+}
+
+void forEachRowPanel(struct PcaContext * ctx, void (*kernel)(struct PcaContext * ctx, double panel[], int panelrows, int firstrow, void * arg),
+                     void (*singlekernel)(struct PcaContext * ctx, float panel[], int panelrows, int firstrow, void * arg), void * arg) {
+    if (!ctx->opts.streaming) {
+        applyPanelKernel(ctx, ctx->opts.singleprecision ? (void *) ctx->AlocalSingle : (void *) ctx->Alocal, ctx->localrows, 0, kernel, singlekernel, arg);
+        return;
+    }
+
+    struct PanelRead panelreads[2];
+    pthread_t reader;
+    int overlap = ctx->mpi_thread_support >= MPI_THREAD_SERIALIZED;
+    int numpanels = (ctx->localrows + ctx->opts.streamrows - 1)/ctx->opts.streamrows;
+    int panelidx;
+    double waitstart;
+
+    if (numpanels == 0) {
+        return;
+    }
+    panelreads[0].ctx = ctx;
+    panelreads[1].ctx = ctx;
+    panelreads[0].buffer = ctx->StreamBuffers[0];
+    panelreads[0].firstrow = 0;
+    panelreads[0].numrows = ctx->opts.streamrows < ctx->localrows ? ctx->opts.streamrows : ctx->localrows;
+    waitstart = MPI_Wtime();
+    readRowPanel(&panelreads[0]);
+    ctx->tstreamwait += MPI_Wtime() - waitstart;
+
+    for(panelidx = 0; panelidx < numpanels; panelidx = panelidx + 1) {
+        struct PanelRead * current = &panelreads[panelidx % 2];
+        struct PanelRead * next = &panelreads[(panelidx + 1) % 2];
+        int havenext = panelidx + 1 < numpanels;
+        if (current->status < 0) {
+            printf("Failed to read rows %ld--%ld on process %d\n", ctx->startingrow + current->firstrow, ctx->startingrow + current->firstrow + current->numrows - 1, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+        if (havenext) {
+            next->buffer = ctx->StreamBuffers[(panelidx + 1) % 2];
+            next->firstrow = current->firstrow + current->numrows;
+            next->numrows = ctx->localrows - next->firstrow < ctx->opts.streamrows ? ctx->localrows - next->firstrow : ctx->opts.streamrows;
+            if (overlap && pthread_create(&reader, NULL, readRowPanel, next) != 0) {
+                overlap = 0;
+            }
+        }
+        applyPanelKernel(ctx, current->buffer, current->numrows, current->firstrow, kernel, singlekernel, arg);
+        if (havenext) {
+            waitstart = MPI_Wtime();
+            if (overlap) {
+                pthread_join(reader, NULL);
+            } else {
+                readRowPanel(next);
+            }
+            ctx->tstreamwait += MPI_Wtime() - waitstart;
+        }
+    }
+}
+
+#define TSQR_R_TAG 1
+#define TSQR_U_TAG 2
+
+void localQR(struct PcaContext * ctx, double M[], int m, int k, double Q[], double R[]) {
+    int rowidx, colidx;
+    memset(R, 0, k * k * sizeof(double));
+    if (m < k) {
+        // too few rows to factor: M = [I 0] * [M; 0]
+        for(rowidx = 0; rowidx < m; rowidx = rowidx + 1) {
+            for(colidx = 0; colidx < k; colidx = colidx + 1) {
+                R[rowidx*k + colidx] = M[rowidx*k + colidx];
+            }
+        }
+        memset(Q, 0, m * k * sizeof(double));
+        for(rowidx = 0; rowidx < m; rowidx = rowidx + 1) {
+            Q[rowidx*k + rowidx] = 1.0;
+        }
+        return;
+    }
+    double * tau = (double *) malloc( k * sizeof(double));
+    if (tau == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    if (Q != M) {
+        memcpy(Q, M, (size_t) m * k * sizeof(double));
+    }
+    LAPACKE_dgeqrf(LAPACK_ROW_MAJOR, m, k, Q, k, tau);
+    for(rowidx = 0; rowidx < k; rowidx = rowidx + 1) {
+        for(colidx = rowidx; colidx < k; colidx = colidx + 1) {
+            R[rowidx*k + colidx] = Q[rowidx*k + colidx];
+        }
+    }
+    LAPACKE_dorgqr(LAPACK_ROW_MAJOR, m, k, k, Q, k, tau);
+    free(tau);
+}
+
+void distributedTallSkinnySVD(struct PcaContext * ctx, MPI_Comm tsqrcomm, double Mlocal[], int rowsLocal, int k, double Ulocal[], double S[], double VT[]) {
+    int numlevels = 0, levelidx, step, tsqrsize, tsqrrank;
+    MPI_Comm_size(tsqrcomm, &tsqrsize);
+    MPI_Comm_rank(tsqrcomm, &tsqrrank);
+    while ((1 << numlevels) < tsqrsize) {
+        numlevels = numlevels + 1;
+    }
+    double * R = (double *) malloc( k * k * sizeof(double));
+    double * stacked = (double *) malloc( 2 * k * k * sizeof(double));
+    double * M = (double *) malloc( 2 * k * k * sizeof(double)); // the k-by-k block of U's factors coming down the tree, and its 2k-by-k image
+    double ** levelQ = (double **) calloc( numlevels + 1, sizeof(double *)); // 2k-by-k Q factors of the merges this rank did
+    if (R == NULL || stacked == NULL || M == NULL || levelQ == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+
+    // leaf: Mlocal = Qlocal * R, Qlocal goes in Ulocal
+    localQR(ctx, Mlocal, rowsLocal, k, Ulocal, R);
+
+    // up the tree: at level l, ranks that are multiples of 2^(l+1) absorb the R of the rank 2^l above them
+    int parentlevel = numlevels; // level at which this rank hands its R to its parent; rank 0 never does
+    for(levelidx = 0, step = 1; levelidx < numlevels; levelidx = levelidx + 1, step = step*2) {
+        if (tsqrrank % (2*step) == step) {
+            MPI_Send(R, k*k, MPI_DOUBLE, tsqrrank - step, TSQR_R_TAG, tsqrcomm);
+            parentlevel = levelidx;
+            break;
+        }
+        if (tsqrrank + step < tsqrsize) {
+            cblas_dcopy(k*k, R, 1, stacked, 1);
+            MPI_Recv(stacked + k*k, k*k, MPI_DOUBLE, tsqrrank + step, TSQR_R_TAG, tsqrcomm, MPI_STATUS_IGNORE);
+            levelQ[levelidx] = (double *) malloc( 2 * k * k * sizeof(double));
+            if (levelQ[levelidx] == NULL) {
+                printf("Out of memory on process %d\n", ctx->mpi_rank);
+                exit(-1);
+            }
+            localQR(ctx, stacked, 2*k, k, levelQ[levelidx], R);
+        }
+    }
+
+    // root: SVD of the final R = Ur*S*VT, and Ur starts down the tree
+    if (tsqrrank == 0) {
+        int info = LAPACKE_dgesdd(LAPACK_ROW_MAJOR, 'S', k, k, R, k, S, M, k, VT, k);
+        if (info != 0) {
+            printf("dgesdd failed with info %d\n", info);
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+    MPI_Bcast(S, k, MPI_DOUBLE, 0, tsqrcomm);
+    MPI_Bcast(VT, k*k, MPI_DOUBLE, 0, tsqrcomm);
+
+    // down the tree: each merge maps the incoming k-by-k block through its 2k-by-k Q, keeps the top half and passes the bottom half back
+    if (tsqrrank != 0) {
+        MPI_Recv(M, k*k, MPI_DOUBLE, tsqrrank - (1 << parentlevel), TSQR_U_TAG, tsqrcomm, MPI_STATUS_IGNORE);
+    }
+    for(levelidx = parentlevel - 1; levelidx >= 0; levelidx = levelidx - 1) {
+        if (levelQ[levelidx] != NULL) {
+            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 2*k, k, k, 1.0, levelQ[levelidx], k, M, k, 0.0, stacked, k);
+            MPI_Send(stacked + k*k, k*k, MPI_DOUBLE, tsqrrank + (1 << levelidx), TSQR_U_TAG, tsqrcomm);
+            cblas_dcopy(k*k, stacked, 1, M, 1);
+            free(levelQ[levelidx]);
+        }
+    }
+
+    // leaf: Ulocal = Qlocal * M
+    double * Qlocal = (double *) malloc( (size_t) (rowsLocal > 0 ? rowsLocal : 1) * k * sizeof(double));
+    if (Qlocal == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    memcpy(Qlocal, Ulocal, (size_t) rowsLocal * k * sizeof(double));
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, rowsLocal, k, k, 1.0, Qlocal, k, M, k, 0.0, Ulocal, k);
+
+    free(Qlocal);
+    free(R);
+    free(stacked);
+    free(M);
+    free(levelQ);
+}
+
+// computes C = A*Omega 
+void multiplyAChunk(double A[], double Omega[], double C[], int rowsA, int colsA, int colsOmega) {
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, rowsA, colsOmega, colsA, 1.0, A, colsA, Omega, colsOmega, 0.0, C, colsOmega);
+}
+
+/* computes A'*(A*Omega) = A*S , so Scratch must have size rowsA*colsOmega */
+void multiplyGramianChunk(double A[], double Omega[], double C[], double Scratch[], int rowsA, int colsA, int colsOmega, int accumulate) {
+    //printf("A should have size %d by %d\n", rowsA, colsA);
+    //printf("Omega should have size %d by %d\n", colsA, colsOmega);
+    //printf("Scratch = A*Omega should have size %d by %d\n", rowsA, colsOmega);
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, rowsA, colsOmega, colsA, 1.0, A, colsA, Omega, colsOmega, 0.0, Scratch, colsOmega);
+    //printf("after dgemm 1");
+    cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, colsA, colsOmega, rowsA, 1.0, A, colsA, Scratch, colsOmega, accumulate ? 1.0 : 0.0, C, colsOmega);
+    //printf("after dgemm 2");
+    /*
+    double * C2 = (double *) malloc( sizeof(double) * colsA * colsOmega );
+    double * A2 = (double *) malloc( sizeof(double) * rowsA * colsA );
+    double * ScratchMe = (double *) malloc( sizeof(double) * rowsA * colsOmega);
+    if (C2 == NULL || A2 == NULL || ScratchMe == NULL) {
+        printf("Out of memory on process %d\n", mpi_rank);
+        exit(-1);
+    }
+    cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, colsA, colsOmega, rowsA, 1.0, A2, colsA, ScratchMe, colsOmega, 0.0, C, colsOmega);
+    */
+}
+
+int gramPanelRows(struct PcaContext * ctx, int colsA) {
+    int panelrows = ctx->opts.panelkb*1024/(colsA*sizeof(double));
+    return panelrows < 1 ? 1 : panelrows;
+}
+
+/* computes y = A'*(A*x) reading A from memory once: each row panel is small enough to stay in cache between
+   forming its entries of A*x and accumulating panel'*(A*x) into y. Panels are split statically over the threads,
+   each of which keeps its own partial y; the partials are summed over column ranges at the end */
+void multiplyGramianVec(struct PcaContext * ctx, const double A[], const double x[], double y[], int rowsA, int colsA, int accumulate) {
+    int panelrows = gramPanelRows(ctx, colsA);
+    int numpanels = (rowsA + panelrows - 1)/panelrows;
+    #pragma omp parallel
+    {
+        int numthreads = omp_get_num_threads();
+        double * ypartial = ctx->ThreadScratch + (long) omp_get_thread_num() * (colsA + panelrows);
+        double * Ax = ypartial + colsA;
+        int panelidx, rowidx, colidx, threadidx;
+
+        memset(ypartial, 0, colsA * sizeof(double));
+        #pragma omp for schedule(static)
+        for(panelidx = 0; panelidx < numpanels; panelidx = panelidx + 1) {
+            int firstrow = panelidx*panelrows;
+            int lastrow = firstrow + panelrows > rowsA ? rowsA : firstrow + panelrows;
+            for(rowidx = firstrow; rowidx < lastrow; rowidx = rowidx + 1) {
+                const double * row = A + (long) rowidx*colsA;
+                double dot = 0;
+                #pragma omp simd reduction(+:dot)
+                for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+                    dot += row[colidx]*x[colidx];
+                }
+                Ax[rowidx - firstrow] = dot;
+            }
+            for(rowidx = firstrow; rowidx < lastrow; rowidx = rowidx + 1) {
+                const double * row = A + (long) rowidx*colsA;
+                double scale = Ax[rowidx - firstrow];
+                #pragma omp simd
+                for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+                    ypartial[colidx] += scale*row[colidx];
+                }
+            }
+        }
+        // the implicit barrier above means every partial is complete and x has been fully read, so y can overwrite it
+        #pragma omp for schedule(static)
+        for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+            double sum = 0;
+            for(threadidx = 0; threadidx < numthreads; threadidx = threadidx + 1) {
+                sum += ctx->ThreadScratch[(long) threadidx*(colsA + panelrows) + colidx];
+            }
+            y[colidx] = accumulate ? y[colidx] + sum : sum;
+        }
+    }
+}
+
+/* same panel structure as multiplyGramianVec, on single precision rows: x is rounded to single precision once so the row
+   products vectorize in single precision, and both A*x and A'*(A*x) are accumulated in double */
+void multiplyGramianVecSingle(struct PcaContext * ctx, const float A[], const double x[], double y[], int rowsA, int colsA, int accumulate) {
+    int panelrows = gramPanelRows(ctx, colsA);
+    int numpanels = (rowsA + panelrows - 1)/panelrows;
+    #pragma omp parallel
+    {
+        int numthreads = omp_get_num_threads();
+        double * ypartial = ctx->ThreadScratch + (long) omp_get_thread_num() * (colsA + panelrows);
+        double * Ax = ypartial + colsA;
+        int panelidx, rowidx, colidx, threadidx;
+
+        #pragma omp for schedule(static)
+        for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+            ctx->XSingle[colidx] = (float) x[colidx];
+        }
+        memset(ypartial, 0, colsA * sizeof(double));
+        #pragma omp for schedule(static)
+        for(panelidx = 0; panelidx < numpanels; panelidx = panelidx + 1) {
+            int firstrow = panelidx*panelrows;
+            int lastrow = firstrow + panelrows > rowsA ? rowsA : firstrow + panelrows;
+            for(rowidx = firstrow; rowidx < lastrow; rowidx = rowidx + 1) {
+                const float * row = A + (long) rowidx*colsA;
+                double dot = 0;
+                #pragma omp simd reduction(+:dot)
+                for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+                    dot += row[colidx]*ctx->XSingle[colidx];
+                }
+                Ax[rowidx - firstrow] = dot;
+            }
+            for(rowidx = firstrow; rowidx < lastrow; rowidx = rowidx + 1) {
+                const float * row = A + (long) rowidx*colsA;
+                float scale = (float) Ax[rowidx - firstrow];
+                #pragma omp simd
+                for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+                    ypartial[colidx] += row[colidx]*scale;
+                }
+            }
+        }
+        #pragma omp for schedule(static)
+        for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+            double sum = 0;
+            for(threadidx = 0; threadidx < numthreads; threadidx = threadidx + 1) {
+                sum += ctx->ThreadScratch[(long) threadidx*(colsA + panelrows) + colidx];
+            }
+            y[colidx] = accumulate ? y[colidx] + sum : sum;
+        }
+    }
+}
+
+// rereads the first rows of every rank's block in both precisions and compares the summed Gram matvecs against a fixed vector
+void checkSinglePrecisionAccuracy(struct PcaContext * ctx, char * infilename, char * datasetname) {
+    int samplerows = ctx->localrows < PRECISION_SAMPLE_ROWS ? ctx->localrows : PRECISION_SAMPLE_ROWS;
+    double * sampleDouble = (double *) malloc( (size_t) (samplerows > 0 ? samplerows : 1) * ctx->numcols * sizeof(double));
+    float * sampleSingle = (float *) malloc( (size_t) (samplerows > 0 ? samplerows : 1) * ctx->numcols * sizeof(float));
+    double * x = (double *) malloc( ctx->numcols * sizeof(double));
+    double * yDouble = (double *) malloc( ctx->numcols * sizeof(double));
+    double * ySingle = (double *) malloc( ctx->numcols * sizeof(double));
+    if (sampleDouble == NULL || sampleSingle == NULL || x == NULL || yDouble == NULL || ySingle == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+
+    hsize_t offset[2], count[2];
+    offset[0] = ctx->startingrow;
+    offset[1] = 0;
+    count[0] = samplerows;
+    count[1] = ctx->numcols;
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, MPI_INFO_NULL);
+    hid_t file_id = H5Fopen(infilename, H5F_ACC_RDONLY, plist_id);
+    hid_t dataset_id = H5Dopen(file_id, datasetname, H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset_id);
+    hid_t memspace = H5Screate_simple(2, count, NULL);
+    hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_INDEPENDENT);
+    if (samplerows > 0) {
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+        herr_t status = H5Dread(dataset_id, H5T_NATIVE_DOUBLE, memspace, filespace, dxpl_id, sampleDouble);
+        status |= H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace, filespace, dxpl_id, sampleSingle);
+        if (status < 0) {
+            printf("Failed to reread the sample rows of %s on process %d\n", datasetname, ctx->mpi_rank);
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+    H5Pclose(dxpl_id);
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    H5Pclose(plist_id);
+
+    int colidx;
+    for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+        x[colidx] = cos(colidx + 1.0)/sqrt(ctx->numcols);
+    }
+    multiplyGramianVec(ctx, sampleDouble, x, yDouble, samplerows, ctx->numcols, 0);
+    multiplyGramianVecSingle(ctx, sampleSingle, x, ySingle, samplerows, ctx->numcols, 0);
+    MPI_Allreduce(MPI_IN_PLACE, yDouble, ctx->numcols, MPI_DOUBLE, MPI_SUM, ctx->comm);
+    MPI_Allreduce(MPI_IN_PLACE, ySingle, ctx->numcols, MPI_DOUBLE, MPI_SUM, ctx->comm);
+
+    // ranks with fewer local rows sample all of them
+    long localsamplerows = samplerows, samplerowsum = 0;
+    MPI_Reduce(&localsamplerows, &samplerowsum, 1, MPI_LONG, MPI_SUM, 0, ctx->comm);
+
+    double errnorm = 0, refnorm = 0;
+    for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+        errnorm += (ySingle[colidx] - yDouble[colidx])*(ySingle[colidx] - yDouble[colidx]);
+        refnorm += yDouble[colidx]*yDouble[colidx];
+    }
+    if (ctx->mpi_rank == 0) {
+        printf("Relative error of the single precision Gram matvec against double precision on %ld sampled rows (at most %d per rank): %g\n",
+               samplerowsum, PRECISION_SAMPLE_ROWS, refnorm > 0 ? sqrt(errnorm/refnorm) : 0.0);
+    }
+
+    free(sampleDouble);
+    free(sampleSingle);
+    free(x);
+    free(yDouble);
+    free(ySingle);
+}
+
+void multiplyAVec(const double A[], const double x[], double t[], int rowsA, int colsA) {
+    int rowidx;
+    #pragma omp parallel for schedule(static)
+    for(rowidx = 0; rowidx < rowsA; rowidx = rowidx + 1) {
+        const double * row = A + (long) rowidx*colsA;
+        double dot = 0;
+        int colidx;
+        #pragma omp simd reduction(+:dot)
+        for(colidx = 0; colidx < colsA; colidx = colidx + 1) {
+            dot += row[colidx]*x[colidx];
+        }
+        t[rowidx] = dot;
+    }
+}
+
+void multiplyATransVecCols(struct PcaContext * ctx, const double A[], const double t[], double y[], int rowsA, int colsA, int firstcol, int lastcol) {
+    int numsegcols = lastcol - firstcol;
+    #pragma omp parallel
+    {
+        int numthreads = omp_get_num_threads();
+        double * ypartial = ctx->ThreadScratch + (long) omp_get_thread_num() * numsegcols;
+        int rowidx, colidx, threadidx;
+
+        memset(ypartial, 0, numsegcols * sizeof(double));
+        #pragma omp for schedule(static)
+        for(rowidx = 0; rowidx < rowsA; rowidx = rowidx + 1) {
+            const double * rowseg = A + (long) rowidx*colsA + firstcol;
+            double scale = t[rowidx];
+            #pragma omp simd
+            for(colidx = 0; colidx < numsegcols; colidx = colidx + 1) {
+                ypartial[colidx] += scale*rowseg[colidx];
+            }
+        }
+        #pragma omp for schedule(static)
+        for(colidx = 0; colidx < numsegcols; colidx = colidx + 1) {
+            double sum = 0;
+            for(threadidx = 0; threadidx < numthreads; threadidx = threadidx + 1) {
+                sum += ctx->ThreadScratch[(long) threadidx*numsegcols + colidx];
+            }
+            y[colidx] = sum;
+        }
+    }
+}
+
+/* the rows are dealt out in small dynamic batches since their lengths vary; each row's entries are read twice back to back,
+   for its entry of A*x and for its contribution to A'*(A*x), so the second read hits cache */
+void multiplyGramianVecCsr(struct PcaContext * ctx, const double x[], double y[], int accumulate) {
+    int stride = ctx->numcols + gramPanelRows(ctx, ctx->numcols); // the ThreadScratch layout of multiplyGramianVec
+    #pragma omp parallel
+    {
+        int numthreads = omp_get_num_threads();
+        double * ypartial = ctx->ThreadScratch + (long) omp_get_thread_num() * stride;
+        int rowidx, colidx, threadidx;
+        long entryidx;
+
+        memset(ypartial, 0, ctx->numcols * sizeof(double));
+        #pragma omp for schedule(dynamic, 64)
+        for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+            double dot = 0;
+            for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+                dot += ctx->CsrValues[entryidx]*x[ctx->CsrColIdx[entryidx]];
+            }
+            for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+                ypartial[ctx->CsrColIdx[entryidx]] += dot*ctx->CsrValues[entryidx];
+            }
+        }
+        // the implicit barrier above means x has been fully read, so y can overwrite it
+        #pragma omp for schedule(static)
+        for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+            double sum = 0;
+            for(threadidx = 0; threadidx < numthreads; threadidx = threadidx + 1) {
+                sum += ctx->ThreadScratch[(long) threadidx*stride + colidx];
+            }
+            y[colidx] = accumulate ? y[colidx] + sum : sum;
+        }
+    }
+}
+
+void reserveCsrPartials(struct PcaContext * ctx, int colsOmega) {
+    if (colsOmega <= ctx->csrpartialcols) {
+        return;
+    }
+    free(ctx->CsrPartials);
+    ctx->CsrPartials = (double *) malloc( (size_t) omp_get_max_threads() * ((long) ctx->numcols*colsOmega + colsOmega) * sizeof(double));
+    if (ctx->CsrPartials == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    ctx->csrpartialcols = colsOmega;
+}
+
+void multiplyGramianChunkCsr(struct PcaContext * ctx, const double Omega[], double C[], int colsOmega) {
+    long partialsize = (long) ctx->numcols*colsOmega + colsOmega;
+    reserveCsrPartials(ctx, colsOmega);
+    double * partials = ctx->CsrPartials;
+    #pragma omp parallel
+    {
+        int numthreads = omp_get_num_threads();
+        double * Cpartial = partials + omp_get_thread_num() * partialsize;
+        double * rowprod = Cpartial + (long) ctx->numcols*colsOmega;
+        int rowidx, vecidx, threadidx;
+        long entryidx, outidx;
+
+        memset(Cpartial, 0, (long) ctx->numcols*colsOmega * sizeof(double));
+        #pragma omp for schedule(dynamic, 64)
+        for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+            memset(rowprod, 0, colsOmega * sizeof(double));
+            for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+                const double * Omegarow = Omega + (long) ctx->CsrColIdx[entryidx]*colsOmega;
+                double value = ctx->CsrValues[entryidx];
+                for(vecidx = 0; vecidx < colsOmega; vecidx = vecidx + 1) {
+                    rowprod[vecidx] += value*Omegarow[vecidx];
+                }
+            }
+            for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+                double * Crow = Cpartial + (long) ctx->CsrColIdx[entryidx]*colsOmega;
+                double value = ctx->CsrValues[entryidx];
+                for(vecidx = 0; vecidx < colsOmega; vecidx = vecidx + 1) {
+                    Crow[vecidx] += value*rowprod[vecidx];
+                }
+            }
+        }
+        #pragma omp for schedule(static)
+        for(outidx = 0; outidx < (long) ctx->numcols*colsOmega; outidx = outidx + 1) {
+            double sum = 0;
+            for(threadidx = 0; threadidx < numthreads; threadidx = threadidx + 1) {
+                sum += partials[threadidx*partialsize + outidx];
+            }
+            C[outidx] = sum;
+        }
+    }
+}
+
+void multiplyAChunkCsr(struct PcaContext * ctx, const double Omega[], double C[], int colsOmega) {
+    int rowidx;
+    #pragma omp parallel for schedule(dynamic, 64)
+    for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+        double * Crow = C + (long) rowidx*colsOmega;
+        long entryidx;
+        int vecidx;
+        memset(Crow, 0, colsOmega * sizeof(double));
+        for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+            const double * Omegarow = Omega + (long) ctx->CsrColIdx[entryidx]*colsOmega;
+            double value = ctx->CsrValues[entryidx];
+            for(vecidx = 0; vecidx < colsOmega; vecidx = vecidx + 1) {
+                Crow[vecidx] += value*Omegarow[vecidx];
+            }
+        }
+    }
+}
+
+void columnMomentsCsr(struct PcaContext * ctx, double sums[], double sumsquares[]) {
+    reserveCsrPartials(ctx, 2);
+    long stride = 2L*ctx->numcols + 2; // the CsrPartials layout of reserveCsrPartials
+    #pragma omp parallel
+    {
+        int numthreads = omp_get_num_threads();
+        double * partial = ctx->CsrPartials + omp_get_thread_num() * stride;
+        int rowidx, colidx, threadidx;
+        long entryidx;
+
+        memset(partial, 0, 2 * ctx->numcols * sizeof(double));
+        #pragma omp for schedule(dynamic, 64)
+        for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+            for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+                double value = ctx->CsrValues[entryidx];
+                partial[ctx->CsrColIdx[entryidx]] += value;
+                partial[ctx->numcols + ctx->CsrColIdx[entryidx]] += value*value;
+            }
+        }
+        #pragma omp for schedule(static)
+        for(colidx = 0; colidx < ctx->numcols; colidx = colidx + 1) {
+            for(threadidx = 0; threadidx < numthreads; threadidx = threadidx + 1) {
+                sums[colidx] += ctx->CsrPartials[threadidx*stride + colidx];
+                sumsquares[colidx] += ctx->CsrPartials[threadidx*stride + ctx->numcols + colidx];
+            }
+        }
+    }
+}
+
+// the weights are those of checksumPanel, so the checksum is the one of the dense matrix
+double checksumCsr(struct PcaContext * ctx) {
+    double sum = 0;
+    int rowidx;
+    #pragma omp parallel for reduction(+:sum) schedule(dynamic, 64)
+    for(rowidx = 0; rowidx < ctx->localrows; rowidx = rowidx + 1) {
+        long globalrow = ctx->startingrow + rowidx, entryidx;
+        for(entryidx = ctx->CsrRowPtr[rowidx]; entryidx < ctx->CsrRowPtr[rowidx + 1]; entryidx = entryidx + 1) {
+            sum += ctx->CsrValues[entryidx]*(1 + ((globalrow*7 + ctx->CsrColIdx[entryidx]*13) % 101)/101.0);
+        }
+    }
+    return sum;
+}
+
+void printvec(char * label, double * v, int length) {
+    if (!DISPLAY_FLAG) {
+        return;
+    }
+    char buffer[2000];
+    int nextpos = 0;
+    nextpos = sprintf(buffer, label);
+    int idx;
+    int practical_length = length < 20 ? length : 20;
+    for(idx = 0; idx < practical_length; idx = idx + 1) {
+        nextpos = nextpos + sprintf(buffer + nextpos, "%f, ", v[idx]);
+    }
+    sprintf(buffer + nextpos - 2, "\n");
+    printf(buffer);
+}
+
+// prints a matrix stored in row major format
+void printmat(char * label, double * mat, int height, int width) {
+    if (!DISPLAY_FLAG) {
+        return;
+    }
+    char buffer[2000];
+    int nextpos = 0;
+    nextpos = sprintf(buffer, label);
+    int rowidx, colidx;
+    for( rowidx = 0; rowidx < height; rowidx = rowidx + 1) {
+        for(colidx = 0; colidx < width; colidx = colidx + 1) {
+            nextpos = nextpos + sprintf(buffer + nextpos, "%f, ", mat[rowidx*width + colidx]);
+        }
+        sprintf(buffer + nextpos - 2, "\n");
+        nextpos = nextpos - 1;
+    }
+    printf(buffer); 
+}
+
+// copies matrix A
+static void dgecopy(const double * A, long m, long n, long incRowA, long incColA, double * B, long incRowB, long incColB)
+{
+    long i, j;
+    #pragma omp parallel for private(i) schedule(static)
+    for (j=0; j<n; ++j) {
+        for (i=0; i<m; ++i) {
+            B[i*incRowB+j*incColB] = A[i*incRowA+j*incColA];
+        }
+    }
+}
+
+// stores the transpose of matrix A in matrix B
+void mattrans(const double * A, long m, long n, double * B) {
+    dgecopy(A, m, n, n, 1, B, 1, m); 
+}
+
+// flips the left-right ordering of the columns of a matrix stored in rowmajor format
+void flipcolslr(double * A, long m, long n) {
+    long rowidx;
+    // each row is contiguous in row major order, so the threads reverse whole rows
+    #pragma omp parallel for schedule(static)
+    for(rowidx = 0; rowidx < m; rowidx = rowidx + 1) {
+        double * row = A + rowidx*n;
+        long idx;
+        for(idx = 0; idx < n/2; idx = idx + 1) {
+            double swap = row[idx];
+            row[idx] = row[n - 1 - idx];
+            row[n - 1 - idx] = swap;
+        }
+    }
+}
+
+void firstTouchRows(void * buffer, long numrows, size_t rowbytes, int panelrows) {
+    long numpanels = (numrows + panelrows - 1)/panelrows, panelidx;
+    #pragma omp parallel for schedule(static)
+    for(panelidx = 0; panelidx < numpanels; panelidx = panelidx + 1) {
+        long firstrow = panelidx*panelrows;
+        long rows = numrows - firstrow < panelrows ? numrows - firstrow : panelrows;
+        memset((char *) buffer + firstrow*rowbytes, 0, rows*rowbytes);
+    }
+}
+
+// orthonormalizes the columns of the m-by-n row major matrix Q in place via a Householder QR
+void orthonormalize(struct PcaContext * ctx, double Q[], int m, int n) {
+    double * tau = (double *) malloc( n * sizeof(double));
+    if (tau == NULL) {
+        printf("Out of memory on process %d\n", ctx->mpi_rank);
+        exit(-1);
+    }
+    LAPACKE_dgeqrf(LAPACK_ROW_MAJOR, m, n, Q, n, tau);
+    LAPACKE_dorgqr(LAPACK_ROW_MAJOR, m, n, n, Q, n, tau);
+    free(tau);
+}
+
+void writeDatasetCollective(struct PcaContext * ctx, hid_t file_id, const char * name, int ndims, hsize_t dims[], hsize_t chunkrows, hsize_t offset[], hsize_t count[], double buf[]) {
+    hid_t dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+    if (chunkrows > 0) {
+        hsize_t chunkdims[2];
+        chunkdims[0] = chunkrows < dims[0] ? chunkrows : dims[0];
+        chunkdims[1] = dims[1];
+        H5Pset_chunk(dcpl_id, ndims, chunkdims);
+    }
+    hid_t filespace = H5Screate_simple(ndims, dims, NULL);
+    hid_t dataset_id = H5Dcreate2(file_id, name, H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+
+    // every rank takes part in the collective write, ranks without data select nothing
+    hsize_t memdims[2];
+    memdims[0] = count[0] > 0 ? count[0] : 1;
+    memdims[1] = ndims > 1 ? count[1] : 1;
+    hid_t memspace = H5Screate_simple(ndims, memdims, NULL);
+    if (count[0] > 0) {
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+    } else {
+        H5Sselect_none(filespace);
+        H5Sselect_none(memspace);
+    }
+    hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_COLLECTIVE);
+    herr_t status = H5Dwrite(dataset_id, H5T_NATIVE_DOUBLE, memspace, filespace, dxpl_id, buf);
+    if (status < 0) {
+        printf("Failed to write %s on process %d\n", name, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+
+    H5Pclose(dxpl_id);
+    H5Sclose(memspace);
+    H5Dclose(dataset_id);
+    H5Sclose(filespace);
+    H5Pclose(dcpl_id);
+}
+
+hid_t createOutputFile(struct PcaContext * ctx, const char * outfname) {
+    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(plist_id, ctx->comm, MPI_INFO_NULL);
+    if (ctx->opts.outalignment > 0) {
+        H5Pset_alignment(plist_id, 0, ctx->opts.outalignment);
+    }
+    hid_t file_id = H5Fcreate(outfname, H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
+    if (file_id < 0) {
+        printf("Could not create %s on process %d\n", outfname, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+    H5Pclose(plist_id);
+    return file_id;
+}
+
+void writeRowBlocksCollective(struct PcaContext * ctx, hid_t file_id, const char * name, hsize_t dims[], hsize_t chunkrows, int numblocks, hsize_t blockoffsets[], hsize_t blockcounts[], double buf[]) {
+    hid_t dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+    if (chunkrows > 0) {
+        hsize_t chunkdims[2];
+        chunkdims[0] = chunkrows < dims[0] ? chunkrows : dims[0];
+        chunkdims[1] = dims[1];
+        H5Pset_chunk(dcpl_id, 2, chunkdims);
+    }
+    hid_t filespace = H5Screate_simple(2, dims, NULL);
+    hid_t dataset_id = H5Dcreate2(file_id, name, H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+
+    // the union of the blocks is filled from buf in row order, so one collective write covers all of them
+    hsize_t offset[2], count[2], memdims[2], totalrows = 0;
+    int blockidx;
+    H5Sselect_none(filespace);
+    for(blockidx = 0; blockidx < numblocks; blockidx = blockidx + 1) {
+        if (blockcounts[blockidx] > 0) {
+            offset[0] = blockoffsets[blockidx];
+            offset[1] = 0;
+            count[0] = blockcounts[blockidx];
+            count[1] = dims[1];
+            H5Sselect_hyperslab(filespace, totalrows == 0 ? H5S_SELECT_SET : H5S_SELECT_OR, offset, NULL, count, NULL);
+            totalrows = totalrows + blockcounts[blockidx];
+        }
+    }
+    memdims[0] = totalrows > 0 ? totalrows : 1;
+    memdims[1] = dims[1];
+    hid_t memspace = H5Screate_simple(2, memdims, NULL);
+    if (totalrows == 0) {
+        H5Sselect_none(memspace);
+    }
+    hid_t dxpl_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_COLLECTIVE);
+    herr_t status = H5Dwrite(dataset_id, H5T_NATIVE_DOUBLE, memspace, filespace, dxpl_id, buf);
+    if (status < 0) {
+        printf("Failed to write %s on process %d\n", name, ctx->mpi_rank);
+        MPI_Abort(ctx->comm, -1);
+    }
+
+    H5Pclose(dxpl_id);
+    H5Sclose(memspace);
+    H5Dclose(dataset_id);
+    H5Sclose(filespace);
+    H5Pclose(dcpl_id);
+}
+
+void writeComponents(struct PcaContext * ctx, hid_t file_id, double singvals[], double finalV[], double mean[], double std[]) {
+    hsize_t dims[2], offset[2], count[2];
+
+    // S and V are replicated, so only rank 0 contributes data; rank 0 may have no rows of U, so buffers are never NULL
+    dims[0] = ctx->numcols;
+    dims[1] = ctx->numeigs;
+    offset[0] = 0;
+    offset[1] = 0;
+    count[0] = ctx->mpi_rank == 0 ? ctx->numcols : 0;
+    count[1] = ctx->numeigs;
+    writeDatasetCollective(ctx, file_id, "/V", 2, dims, ctx->opts.outchunkrows, offset, count, ctx->mpi_rank == 0 ? finalV : singvals);
+
+    dims[0] = ctx->numeigs;
+    count[0] = ctx->mpi_rank == 0 ? ctx->numeigs : 0;
+    writeDatasetCollective(ctx, file_id, "/S", 1, dims, 0, offset, count, singvals);
+
+    if (mean != NULL) {
+        dims[0] = ctx->numcols;
+        count[0] = ctx->mpi_rank == 0 ? ctx->numcols : 0;
+        writeDatasetCollective(ctx, file_id, "/mean", 1, dims, 0, offset, count, mean);
+    }
+    if (std != NULL) {
+        dims[0] = ctx->numcols;
+        count[0] = ctx->mpi_rank == 0 ? ctx->numcols : 0;
+        writeDatasetCollective(ctx, file_id, "/std", 1, dims, 0, offset, count, std);
+    }
+}
+
+void writeOutput(struct PcaContext * ctx, const char * outfname, double Ulocal[], double singvals[], double finalV[], double mean[], double std[]) {
+    hsize_t dims[2], offset[2], count[2];
+    hid_t file_id = createOutputFile(ctx, outfname);
+
+    dims[0] = ctx->numrows;
+    dims[1] = ctx->numeigs;
+    offset[0] = ctx->startingrow;
+    offset[1] = 0;
+    count[0] = ctx->opts.gridcols == 0 || ctx->gridcol == 0 ? ctx->localrows : 0; // on a grid, grid column 0 holds U
+    count[1] = ctx->numeigs;
+    writeDatasetCollective(ctx, file_id, "/U", 2, dims, ctx->opts.outchunkrows, offset, count, Ulocal);
+    writeComponents(ctx, file_id, singvals, finalV, mean, std);
+    H5Fclose(file_id);
+}
+
+int setOption(struct PcaOptions * opts, const char * name, const char * value) {
+    if (strcmp(name, "--solver") == 0) {
+        if (strcmp(value, "arpack") == 0) {
+            opts->solver = SOLVER_ARPACK;
+        } else if (strcmp(value, "rsvd") == 0) {
+            opts->solver = SOLVER_RSVD;
+        } else if (strcmp(value, "lanczos") == 0) {
+            opts->solver = SOLVER_LANCZOS;
+        } else {
+            return PCA_BAD_VALUE;
+        }
+    } else if (strcmp(name, "--oversample") == 0) {
+        opts->oversampling = atoi(value);
+    } else if (strcmp(name, "--poweriters") == 0) {
+        opts->poweriters = atoi(value);
+    } else if (strcmp(name, "--panelkb") == 0) {
+        opts->panelkb = atoi(value);
+    } else if (strcmp(name, "--commsegments") == 0) {
+        opts->commsegments = atoi(value);
+    } else if (strcmp(name, "--outchunkrows") == 0) {
+        opts->outchunkrows = strtoull(value, NULL, 10);
+    } else if (strcmp(name, "--outalignment") == 0) {
+        opts->outalignment = strtoull(value, NULL, 10);
+    } else if (strcmp(name, "--precision") == 0) {
+        if (strcmp(value, "double") == 0) {
+            opts->singleprecision = 0;
+        } else if (strcmp(value, "single") == 0) {
+            opts->singleprecision = 1;
+        } else {
+            return PCA_BAD_VALUE;
+        }
+    } else if (strcmp(name, "--grid") == 0) {
+        int rows, cols;
+        if (sscanf(value, "%dx%d", &rows, &cols) != 2) {
+            return PCA_BAD_VALUE;
+        }
+        opts->gridrows = rows;
+        opts->gridcols = cols;
+    } else if (strcmp(name, "--readmode") == 0) {
+        int mode;
+        for(mode = 0; mode < NUM_READ_MODES; mode = mode + 1) {
+            if (strcmp(value, readModeNames[mode]) == 0) {
+                break;
+            }
+        }
+        if (mode == NUM_READ_MODES) {
+            return PCA_BAD_VALUE;
+        }
+        opts->readmode = mode;
+    } else if (strcmp(name, "--cbnodes") == 0) {
+        opts->cbnodes = atoi(value);
+    } else if (strcmp(name, "--cbbuffermb") == 0) {
+        opts->cbbuffermb = atoi(value);
+    } else if (strcmp(name, "--chunkalign") == 0) {
+        opts->chunkalign = atoi(value);
+    } else if (strcmp(name, "--checkpoint") == 0) {
+        free(opts->checkpointfname);
+        opts->checkpointfname = strdup(value);
+    } else if (strcmp(name, "--checkpointevery") == 0) {
+        opts->checkpointevery = atoi(value);
+    } else if (strcmp(name, "--resume") == 0) {
+        opts->resume = atoi(value);
+    } else if (strcmp(name, "--report") == 0) {
+        free(opts->reportfname);
+        opts->reportfname = strdup(value);
+    } else if (strcmp(name, "--center") == 0) {
+        opts->center = atoi(value);
+    } else if (strcmp(name, "--scale") == 0) {
+        opts->scale = atoi(value);
+    } else if (strcmp(name, "--vartarget") == 0) {
+        opts->vartarget = atof(value);
+    } else if (strcmp(name, "--sparse") == 0) {
+        opts->sparse = atoi(value);
+    } else if (strcmp(name, "--stream") == 0) {
+        opts->streaming = atoi(value);
+    } else if (strcmp(name, "--streammb") == 0) {
+        opts->streammb = atoi(value);
+    } else if (strcmp(name, "--streamrows") == 0) {
+        opts->streamrows = atoi(value);
+    } else if (strcmp(name, "--tol") == 0) {
+        opts->arpacktol = atof(value);
+    } else if (strcmp(name, "--ncv") == 0) {
+        opts->requestedncv = atoi(value);
+    } else if (strcmp(name, "--maxiter") == 0) {
+        opts->arpackmaxiter = atoi(value);
+    } else {
+        return PCA_UNKNOWN_OPTION;
+    }
+    return PCA_OK;
+}
+
+int pcaSetOption(const char * name, const char * value) {
+    return setOption(&defaultoptions, name, value);
+}
+
+int pcaSetContextOption(struct PcaContext * ctx, const char * name, const char * value) {
+    // the storage of A is fixed once it is loaded
+    const char * storagenames[] = {"--precision", "--grid", "--readmode", "--cbnodes", "--cbbuffermb", "--chunkalign", "--panelkb",
+                                   "--sparse", "--stream", "--streammb", "--streamrows"};
+    int idx;
+    for(idx = 0; idx < (int) (sizeof(storagenames)/sizeof(storagenames[0])); idx = idx + 1) {
+        if (strcmp(name, storagenames[idx]) == 0) {
+            return PCA_BAD_VALUE;
+        }
+    }
+    int status = setOption(&ctx->opts, name, value);
+    if (status == PCA_OK) {
+        checkOptions(ctx);
+    }
+    return status;
+}
+
+void checkOptions(struct PcaContext * ctx) {
+    if (ctx->opts.panelkb <= 0 || ctx->opts.commsegments <= 0 || ctx->opts.commsegments > ctx->numcols) {
+        if (ctx->mpi_rank == 0) {
+            printf("--panelkb must be positive and --commsegments between 1 and numcols\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.streaming && (ctx->opts.streammb <= 0 || ctx->opts.streamrows < 0 || ctx->opts.commsegments > 1)) {
+        if (ctx->mpi_rank == 0) {
+            printf("Streaming needs --streammb > 0, --streamrows >= 0 and can't pipeline the allreduce over segments (it would read every panel twice)\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.cbnodes < 0 || ctx->opts.cbbuffermb < 0 || (ctx->opts.streaming && ctx->opts.readmode != READ_INDEPENDENT)) {
+        if (ctx->mpi_rank == 0) {
+            printf("--cbnodes and --cbbuffermb must be nonnegative, and streamed panels are always read independently\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.checkpointevery <= 0 || (ctx->opts.resume && ctx->opts.checkpointfname == NULL) || (ctx->opts.checkpointfname != NULL && ctx->opts.solver == SOLVER_RSVD)) {
+        if (ctx->mpi_rank == 0) {
+            printf("--checkpointevery must be positive, --resume needs --checkpoint, and only the arpack and lanczos solvers checkpoint\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.sparse && (ctx->opts.streaming || ctx->opts.singleprecision || ctx->opts.commsegments > 1 || ctx->opts.gridrows != 0 || ctx->opts.gridcols != 0 || ctx->opts.readmode == READ_NODELEADER)) {
+        if (ctx->mpi_rank == 0) {
+            printf("--sparse holds the CSR rows in memory in double precision on a 1D distribution, read independently or collectively, with --commsegments 1\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.singleprecision && ctx->opts.commsegments > 1) {
+        if (ctx->mpi_rank == 0) {
+            printf("--commsegments is only implemented for double precision storage\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.vartarget < 0 || ctx->opts.vartarget > 1 || (ctx->opts.vartarget > 0 && ctx->opts.checkpointfname != NULL)) {
+        if (ctx->mpi_rank == 0) {
+            printf("--vartarget must be between 0 and 1, and can't be checkpointed (each attempt has its own number of vectors)\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.gridrows != 0 || ctx->opts.gridcols != 0) {
+        if (ctx->opts.gridrows <= 0 || ctx->opts.gridcols <= 0 || ctx->opts.gridrows*ctx->opts.gridcols != ctx->mpi_size || ctx->opts.gridrows > ctx->numrows || ctx->opts.gridcols > ctx->numcols) {
+            if (ctx->mpi_rank == 0) {
+                printf("--grid %dx%d must have positive dimensions, no more grid rows than rows or grid columns than columns, and exactly %d ranks\n",
+                       ctx->opts.gridrows, ctx->opts.gridcols, ctx->mpi_size);
+            }
+            MPI_Abort(ctx->comm, -1);
+        }
+        if (ctx->opts.streaming || ctx->opts.singleprecision || ctx->opts.commsegments > 1 || ctx->opts.solver != SOLVER_ARPACK) {
+            if (ctx->mpi_rank == 0) {
+                printf("--grid is only implemented for the in-memory, double precision ARPACK solver with --commsegments 1\n");
+            }
+            MPI_Abort(ctx->comm, -1);
+        }
+    }
+    if (ctx->opts.solver == SOLVER_LANCZOS && ctx->opts.commsegments > 1) {
+        if (ctx->mpi_rank == 0) {
+            printf("--commsegments pipelines the allreduce that the lanczos solver replaces with a reduce-scatter\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+    if (ctx->opts.oversampling < 0 || ctx->opts.poweriters < 0) {
+        if (ctx->mpi_rank == 0) {
+            printf("--oversample and --poweriters must be nonnegative\n");
+        }
+        MPI_Abort(ctx->comm, -1);
+    }
+}
+
+int centered(struct PcaContext * ctx) {
+    return ctx->opts.center || ctx->opts.scale;
+}
+
+void phaseAdd(struct PcaContext * ctx, int phase, double seconds) {
+    ctx->phaseTimes[phase] += seconds;
+    ctx->phaseCalls[phase] = ctx->phaseCalls[phase] + 1;
+}
+
+void countMatrixPass(struct PcaContext * ctx, double flopsperentry, int numvecs, int sweeps) {
+    double entries = ctx->opts.sparse ? (double) ctx->localnnz : (double) ctx->localrows*ctx->localcols;
+    ctx->flopcount += flopsperentry*entries*numvecs;
+    ctx->bytecount += sweeps*entries*(ctx->opts.sparse ? sizeof(double) + sizeof(int) : (ctx->opts.singleprecision ? sizeof(float) : sizeof(double)));
+}
+
+void writeTimingReport(struct PcaContext * ctx, char * infilename, double totaltime) {
+    double mintimes[NUM_PHASES], maxtimes[NUM_PHASES], sumtimes[NUM_PHASES], totals[2], globaltotals[2];
+    int maxcalls[NUM_PHASES];
+    MPI_Reduce(ctx->phaseTimes, mintimes, NUM_PHASES, MPI_DOUBLE, MPI_MIN, 0, ctx->comm);
+    MPI_Reduce(ctx->phaseTimes, maxtimes, NUM_PHASES, MPI_DOUBLE, MPI_MAX, 0, ctx->comm);
+    MPI_Reduce(ctx->phaseTimes, sumtimes, NUM_PHASES, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+    MPI_Reduce(ctx->phaseCalls, maxcalls, NUM_PHASES, MPI_INT, MPI_MAX, 0, ctx->comm);
+    totals[0] = ctx->flopcount;
+    totals[1] = ctx->bytecount;
+    MPI_Reduce(totals, globaltotals, 2, MPI_DOUBLE, MPI_SUM, 0, ctx->comm);
+    // the throughput is taken over the slowest rank's time in the passes over A
+    double passtime = ctx->phaseTimes[PHASE_MOMENTS] + ctx->phaseTimes[PHASE_GRAM_COMPUTE] + ctx->phaseTimes[PHASE_AV], maxpasstime;
+    MPI_Reduce(&passtime, &maxpasstime, 1, MPI_DOUBLE, MPI_MAX, 0, ctx->comm);
+    if (ctx->mpi_rank != 0) {
+        return;
+    }
+
+    double gflops = maxpasstime > 0 ? globaltotals[0]/maxpasstime/1e9 : 0;
+    double gbytes = maxpasstime > 0 ? globaltotals[1]/maxpasstime/1e9 : 0;
+    int phase;
+    printf("%-15s %8s %12s %12s %12s %10s\n", "phase", "calls", "min", "mean", "max", "imbalance");
+    for(phase = 0; phase < NUM_PHASES; phase = phase + 1) {
+        double mean = sumtimes[phase]/ctx->mpi_size;
+        printf("%-15s %8d %12f %12f %12f %10.3f\n", phaseNames[phase], maxcalls[phase], mintimes[phase], mean, maxtimes[phase],
+               mean > 0 ? maxtimes[phase]/mean : 1.0);
+    }
+    printf("Passes over A: %.3f GFLOP/s, %.3f GB/s\n", gflops, gbytes);
+
+    if (ctx->opts.reportfname == NULL) {
+        return;
+    }
+    FILE * report = fopen(ctx->opts.reportfname, "a");
+    if (report == NULL) {
+        printf("Could not open %s for the timing report\n", ctx->opts.reportfname);
+        return;
+    }
+    int csv = strlen(ctx->opts.reportfname) > 4 && strcmp(ctx->opts.reportfname + strlen(ctx->opts.reportfname) - 4, ".csv") == 0;
+    const char * solvername = ctx->opts.solver == SOLVER_RSVD ? "rsvd" : (ctx->opts.solver == SOLVER_LANCZOS ? "lanczos" : "arpack");
+    const char * precisionname = ctx->opts.singleprecision ? "single" : "double";
+    if (csv) {
+        fseek(report, 0, SEEK_END);
+        if (ftell(report) == 0) {
+            fprintf(report, "input,ranks,threads,numrows,numcols,numeigs,solver,precision,streaming,sparse,center,commsegments,readmode,matvecs,total_time,gflops,gbytes_per_s");
+            for(phase = 0; phase < NUM_PHASES; phase = phase + 1) {
+                fprintf(report, ",%s_calls,%s_min,%s_mean,%s_max,%s_imbalance", phaseNames[phase], phaseNames[phase], phaseNames[phase], phaseNames[phase], phaseNames[phase]);
+            }
+            fprintf(report, "\n");
+        }
+        writeCsvField(report, infilename);
+        fprintf(report, ",%d,%d,%ld,%d,%d,%s,%s,%d,%d,%d,%d,%s,%d,%f,%f,%f", ctx->mpi_size, omp_get_max_threads(), ctx->numrows, ctx->numcols, ctx->numeigs,
+                solvername, precisionname, ctx->opts.streaming, ctx->opts.sparse, centered(ctx), ctx->opts.commsegments, readModeNames[ctx->opts.readmode], ctx->ngramcalls, totaltime, gflops, gbytes);
+        for(phase = 0; phase < NUM_PHASES; phase = phase + 1) {
+            double mean = sumtimes[phase]/ctx->mpi_size;
+            fprintf(report, ",%d,%f,%f,%f,%f", maxcalls[phase], mintimes[phase], mean, maxtimes[phase], mean > 0 ? maxtimes[phase]/mean : 1.0);
+        }
+        fprintf(report, "\n");
+    } else {
+        fprintf(report, "{\"input\": ");
+        writeJsonString(report, infilename);
+        fprintf(report, ", \"ranks\": %d, \"threads\": %d, \"numrows\": %ld, \"numcols\": %d, \"numeigs\": %d, "
+                "\"solver\": \"%s\", \"precision\": \"%s\", \"streaming\": %d, \"sparse\": %d, \"center\": %d, \"commsegments\": %d, \"readmode\": \"%s\", \"matvecs\": %d, "
+                "\"total_time\": %f, \"gflops\": %f, \"gbytes_per_s\": %f, \"phases\": {",
+                ctx->mpi_size, omp_get_max_threads(), ctx->numrows, ctx->numcols, ctx->numeigs, solvername, precisionname, ctx->opts.streaming, ctx->opts.sparse, centered(ctx),
+                ctx->opts.commsegments, readModeNames[ctx->opts.readmode], ctx->ngramcalls, totaltime, gflops, gbytes);
+        for(phase = 0; phase < NUM_PHASES; phase = phase + 1) {
+            double mean = sumtimes[phase]/ctx->mpi_size;
+            fprintf(report, "%s\"%s\": {\"calls\": %d, \"min\": %f, \"mean\": %f, \"max\": %f, \"imbalance\": %f}", phase > 0 ? ", " : "",
+                    phaseNames[phase], maxcalls[phase], mintimes[phase], mean, maxtimes[phase], mean > 0 ? maxtimes[phase]/mean : 1.0);
+        }
+        fprintf(report, "}}\n");
+    }
+    fclose(report);
+}
+
+void writeJsonString(FILE * report, const char * str) {
+    fputc('"', report);
+    for(; *str != '\0'; str = str + 1) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(report, "\\%c", *str);
+        } else if ((unsigned char) *str < 0x20) {
+            fprintf(report, "\\u%04x", (unsigned char) *str);
+        } else {
+            fputc(*str, report);
+        }
+    }
+    fputc('"', report);
+}
+
+void writeCsvField(FILE * report, const char * str) {
+    fputc('"', report);
+    for(; *str != '\0'; str = str + 1) {
+        if (*str == '"') {
+            fputc('"', report);
+        }
+        fputc(*str, report);
+    }
+    fputc('"', report);
+}
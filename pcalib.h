@@ -0,0 +1,96 @@
+#ifndef PCALIB_H
+#define PCALIB_H
+
+#include "mpi.h"
+
+/* Distributed PCA of a tall matrix held in an HDF5 file, as a library: a context holds one loaded matrix, distributed over the
+   ranks of the communicator it was loaded on, and any number of decompositions can then be computed from memory. Every call
+   taking a context is collective over its communicator. Errors (bad settings, failed reads, running out of memory) abort the
+   job, as they do in the pca command line tool.
+
+   The settings are the command line options of pca. Every context has its own, copied when it is created from the defaults
+   set by pcaSetOption. The storage settings (--precision, --sparse, --stream, --streammb, --streamrows, --grid, --readmode,
+   --cbnodes, --cbbuffermb, --chunkalign, --panelkb) are fixed for a context by pcaLoad; the others (--solver, --oversample,
+   --poweriters, --tol, --ncv, --maxiter, --commsegments, --center, --scale, --vartarget, --checkpoint, --checkpointevery,
+   --resume, --outchunkrows, --outalignment, --report) can be changed for a context with pcaSetContextOption. Contexts share
+   nothing but the defaults, so threads may each work on their own context if MPI was initialized with MPI_THREAD_MULTIPLE
+   and HDF5 is built thread-safe */
+
+#define PCA_OK 0
+#define PCA_UNKNOWN_OPTION 1
+#define PCA_BAD_VALUE 2
+
+struct PcaContext;
+
+// a rank-k decomposition A ~ U*diag(S)*V' (of the centered and scaled A with --center and --scale)
+struct PcaResult {
+    int numeigs; // k
+    int numcols; // columns of A
+    int localrows; // rows of U held by this rank
+    long startingrow; // global index of the first of them
+    double * singvals; // the k singular values in descending order, on every rank
+    double * V; // numcols-by-k right singular vectors (the principal axes), row major, on every rank
+    double * Ulocal; // this rank's localrows-by-k rows of U, row major
+    double * mean; // the column means A was centered with, NULL without --center
+    double * std; // the column standard deviations it was scaled by, NULL without --scale
+};
+
+// sets the default of the option named as on the pca command line (e.g. "--solver", "lanczos") for the contexts created after
+// it; returns PCA_OK, PCA_UNKNOWN_OPTION or PCA_BAD_VALUE. Needs no communication, so it can be called before any context exists
+int pcaSetOption(const char * name, const char * value);
+
+// reads the numrows-by-numcols dataset (or CSR group, with --sparse) of infilename, distributed over the ranks of comm
+struct PcaContext * pcaLoad(MPI_Comm comm, const char * infilename, const char * datasetname, long numrows, int numcols);
+
+// generates a numrows-by-numcols matrix distributed over the ranks of comm without any I/O: exact singular values decay^i for
+// the first signalrank, then a noise floor falling from noise to noise/2, with random (seeded) singular vectors. The matrix
+// does not depend on the number of ranks; every rank needs memory for 3 numcols-by-numcols buffers while it is formed. If
+// exactsingvals is not NULL, it receives the numcols singular values in descending order
+struct PcaContext * pcaGenerate(MPI_Comm comm, long numrows, int numcols, int signalrank, double decay, double noise, int seed, double exactsingvals[]);
+
+// computes the top numeigs principal components of the loaded matrix into result, which the caller frees with pcaFreeResult.
+// With --vartarget f, numeigs is only an upper bound: result->numeigs is the fewest components capturing the fraction f of the
+// total variance (the squared Frobenius norm of the centered and scaled matrix), found by solving for a block of them and
+// then for twice as many at a time
+void pcaCompute(struct PcaContext * ctx, int numeigs, struct PcaResult * result);
+
+// computes the scores of numrows new rows (row major, result->numcols long) on the principal axes of result, centered and
+// scaled the same way, into the numrows-by-numeigs scores; local to the calling rank
+void pcaProject(const struct PcaResult * result, const double rows[], int numrows, double scores[]);
+
+// reads the leading numeigs singular values and right singular vectors (and the mean and standard deviations, if there are
+// any) from a file written by pcaWriteResult into result, without U, on every rank of comm
+void pcaReadComponents(MPI_Comm comm, const char * fname, int numeigs, struct PcaResult * result);
+
+// projects the rows of a numrows-by-numcols dataset of infilename onto the leading numeigs components stored in componentsfname,
+// streaming the rows in panels of --streammb or --streamrows over the ranks of comm, and writes the numrows-by-numeigs scores
+// to /scores of outfname with parallel HDF5
+void pcaProjectFile(MPI_Comm comm, const char * componentsfname, const char * infilename, const char * datasetname, long numrows, int numcols, int numeigs, const char * outfname);
+
+// updates the leading numeigs components stored in oldfname (U, S, V and the mean, if there is one) with numnewrows rows of a
+// dataset of infilename appended below the old ones, and writes the updated U, S, V and mean to outfname. Only the new rows
+// are read, with the storage settings of pcaLoad: the cost is a few passes over them plus rotating the old rows of U, rather
+// than a recomputation over all the rows. The update is exact for the rank numeigs part the old file kept and randomized
+// (--oversample vectors) in the new directions; a file written with --scale cannot be updated
+void pcaUpdateFile(MPI_Comm comm, const char * oldfname, const char * infilename, const char * datasetname, long numnewrows, int numcols, int numeigs, const char * outfname);
+
+// sets an option of ctx alone, like pcaSetOption; the storage settings cannot be changed once the matrix is loaded and give
+// PCA_BAD_VALUE
+int pcaSetContextOption(struct PcaContext * ctx, const char * name, const char * value);
+
+// writes U, S and V (and the mean and standard deviations, if used) to outfname with parallel HDF5
+void pcaWriteResult(struct PcaContext * ctx, const struct PcaResult * result, const char * outfname);
+
+// prints the per-phase timings of the work done so far and, with --report, appends a record of it to the report file
+void pcaReport(struct PcaContext * ctx, double totaltime);
+
+// zeroes the phase timers and flop and byte counters of ctx that pcaReport reports on
+void pcaResetTimers(struct PcaContext * ctx);
+
+void pcaFreeResult(struct PcaResult * result);
+void pcaFree(struct PcaContext * ctx);
+
+// times reps reads of the matrix with every read mode on comm and reports the bandwidths, without keeping the data
+void pcaReadBenchmark(MPI_Comm comm, const char * infilename, const char * datasetname, long numrows, int numcols, int reps);
+
+#endif